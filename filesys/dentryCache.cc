@@ -0,0 +1,165 @@
+// dentryCache.cc
+//	Routines to cache the results of directory lookups.
+//
+//	The entries are a fixed array, chained into a small hash table on
+//	<directory sector, name>.  When all of them are in use, the least
+//	recently used one is replaced.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "utility.h"
+#include "dentryCache.h"
+
+//----------------------------------------------------------------------
+// HashDentry
+// 	Hash a directory sector and the part of a name kept in an entry.
+//----------------------------------------------------------------------
+
+static int
+HashDentry(int parent, char *name)
+{
+    unsigned int hash = parent;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = hash * 33 + (unsigned char) name[i];
+    return hash % DentryBuckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty cache.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache()
+{
+    entries = new Dentry[DentryCacheSize];
+    for (int i = 0; i < DentryCacheSize; i++)
+        entries[i].valid = FALSE;
+    for (int b = 0; b < DentryBuckets; b++)
+        buckets[b] = -1;
+    clock = 0;
+    hits = misses = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    DEBUG('f', "Dentry cache: %d hits, %d misses\n", hits, misses);
+    delete [] entries;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::FindIndex
+// 	Return the entry caching "name" in directory "parent", -1 if none.
+//----------------------------------------------------------------------
+
+int
+DentryCache::FindIndex(int parent, char *name)
+{
+    for (int i = buckets[HashDentry(parent, name)]; i != -1;
+                                                i = entries[i].next)
+        if (entries[i].parent == parent
+                && !strncmp(entries[i].name, name, FileNameMaxLen))
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unlink
+// 	Take entry "i" off its hash chain, and mark it free.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Unlink(int i)
+{
+    int *link = &buckets[HashDentry(entries[i].parent, entries[i].name)];
+
+    while (*link != i) {
+        ASSERT(*link != -1);
+        link = &entries[*link].next;
+    }
+    *link = entries[i].next;
+    entries[i].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look up "name" in directory "parent".  Return FALSE if we don't
+//	know; else TRUE, with the header sector of the file in "sector"
+//	(-1 if the directory has no such name) and its type in "type".
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(int parent, char *name, int *sector, int *type)
+{
+    int i = FindIndex(parent, name);
+
+    if (i == -1) {
+        misses++;
+        return FALSE;
+    }
+    hits++;
+    entries[i].lastUse = clock++;
+    *sector = entries[i].sector;
+    *type = entries[i].type;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember that "name" in directory "parent" has its header at
+//	"sector" (-1: there is no such file), replacing what we knew.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(int parent, char *name, int sector, int type)
+{
+    int i = FindIndex(parent, name);
+
+    if (i == -1) {
+        int victim = 0;
+
+        for (i = 0; i < DentryCacheSize; i++) {
+            if (!entries[i].valid)
+                break;
+            if (entries[i].lastUse < entries[victim].lastUse)
+                victim = i;
+        }
+        if (i == DentryCacheSize) {
+            i = victim;
+            Unlink(i);
+        }
+
+        entries[i].valid = TRUE;
+        entries[i].parent = parent;
+        strncpy(entries[i].name, name, FileNameMaxLen);
+        entries[i].name[FileNameMaxLen] = '\0';
+        int b = HashDentry(parent, name);
+        entries[i].next = buckets[b];
+        buckets[b] = i;
+    }
+    entries[i].sector = sector;
+    entries[i].type = type;
+    entries[i].lastUse = clock++;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Forget
+// 	Drop every lookup in directory "parent", which was removed: its
+//	header sector may soon be given to another file.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Forget(int parent)
+{
+    for (int i = 0; i < DentryCacheSize; i++)
+        if (entries[i].valid && entries[i].parent == parent)
+            Unlink(i);
+}
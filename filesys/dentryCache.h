@@ -0,0 +1,65 @@
+// dentryCache.h
+//	Data structures to cache the results of directory lookups.
+//
+//	FileSystem::FindFile resolves a path one name at a time, and each
+//	step reads a directory from disk, then the header of the file it
+//	found there.  The dentry cache remembers, for a directory and a
+//	name, the sector of the header found and whether it is a file or
+//	a directory -- or that there is no such name ("negative" entry).
+//	A path whose names are all cached resolves without any disk I/O.
+//
+//	The file system has to keep it up to date: Create enters the new
+//	file, Remove turns its entry negative and forgets what was cached
+//	under the removed header, since that sector can be reused.
+//
+//	None of the operations blocks, so there is no lock.
+
+#ifndef DENTRYCACHE_H
+#define DENTRYCACHE_H
+
+#include "copyright.h"
+#include "directory.h"
+
+#define DentryCacheSize 	64	// entries kept
+#define DentryBuckets 		16	// hash chains
+
+// One cached lookup of "name" in the directory whose header is
+// at "parent".
+
+class Dentry {
+  public:
+    bool valid;				// Is this entry in use?
+    int parent;				// Header sector of the directory
+    char name[FileNameMaxLen + 1];	// Name looked up in it
+    int sector;				// Header found, -1 if none
+    int type;				// TYPE_FILE or TYPE_DIR
+    int lastUse;			// For LRU replacement
+    int next;				// Next entry in the same hash
+					//   chain, -1 at the end
+};
+
+class DentryCache {
+  public:
+    DentryCache();			// Initialize an empty cache
+    ~DentryCache();
+
+    bool Lookup(int parent, char *name, int *sector, int *type);
+    					// Return FALSE if not cached; else
+					// return the header sector (-1 if
+					// there is no such file) and type
+    void Enter(int parent, char *name, int sector, int type);
+    					// Remember a lookup, -1 if it failed
+    void Forget(int parent);		// Drop all the lookups in directory
+					// "parent": it was removed
+
+  private:
+    Dentry *entries;			// The cached lookups
+    int buckets[DentryBuckets];		// First entry of each chain
+    int clock;				// Counts the uses, for lastUse
+    int hits, misses;			// Statistics
+
+    int FindIndex(int parent, char *name);
+    void Unlink(int i);			// Take entry "i" off its chain
+};
+
+#endif // DENTRYCACHE_H
@@ -11,10 +11,12 @@
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	The entries form a hash table on the file name, with linear
+//	probing.  A removed entry is left as a "deleted" marker, so that
+//	lookups of names that probed past it still find them; the markers
+//	are dropped when the table is rehashed.  The table doubles once
+//	it is three quarters full, so a directory can hold any number of
+//	files, and Find, Add and Remove look at a few slots only.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -39,8 +41,11 @@ Directory::Directory(int size)
 {
     table = new DirectoryEntry[size];
     tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-	table[i].inUse = FALSE;
+    bzero(table, tableSize * sizeof(DirectoryEntry));
+    numUsed = numDeleted = 0;
+    firstDirty = 0;			// all of it is new
+    lastDirty = tableSize - 1;
+    rehashed = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -57,26 +62,98 @@ Directory::~Directory()
 // Directory::FetchFrom
 // 	Read the contents of the directory from disk.
 //
+//	The table takes the size of the directory file, which may have
+//	been grown through another OpenFile: so re-read its header first.
+//
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
 void
 Directory::FetchFrom(OpenFile *file)
 {
+    file->Refresh();
+    int size = file->Length() / sizeof(DirectoryEntry);
+
+    ASSERT(size > 0);
+    if (size != tableSize) {
+        delete [] table;
+        table = new DirectoryEntry[size];
+        tableSize = size;
+    }
     (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+
+    firstDirty = tableSize;		// same as on disk
+    lastDirty = -1;
+    rehashed = FALSE;
+    numUsed = numDeleted = 0;
+    for (int i = 0; i < tableSize; i++) {
+        if (table[i].inUse)
+            numUsed++;
+        else if (table[i].deleted)
+            numDeleted++;
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
 // 	Write any modifications to the directory back to disk
 //
+//	Only the entries changed since FetchFrom are written, which is
+//	usually one or two sectors.  If the table has grown, the file
+//	does too; the caller must not hold the free map lock.  After a
+//	rehash all of it is, to new sectors (see OpenFile::Rewrite), in
+//	the caller's transaction.
+//
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    if (firstDirty > lastDirty)
+        return;				// nothing changed
+    if (rehashed) {			// all of it: too much to log
+        (void) file->Rewrite((char *)table,
+                 tableSize * sizeof(DirectoryEntry));
+        rehashed = FALSE;
+        firstDirty = tableSize;
+        lastDirty = -1;
+        return;
+    }
+    (void) file->WriteAt((char *)&table[firstDirty],
+                 (lastDirty - firstDirty + 1) * sizeof(DirectoryEntry),
+                 firstDirty * sizeof(DirectoryEntry));
+    firstDirty = tableSize;
+    lastDirty = -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::MarkDirty
+// 	Note that entry "i" has to be written back.
+//----------------------------------------------------------------------
+
+void
+Directory::MarkDirty(int i)
+{
+    if (i < firstDirty)
+        firstDirty = i;
+    if (i > lastDirty)
+        lastDirty = i;
+}
+
+//----------------------------------------------------------------------
+// HashName
+// 	Hash the part of a file name that is kept in a directory entry.
+//----------------------------------------------------------------------
+
+static unsigned int
+HashName(char *name)
+{
+    unsigned int hash = 5381;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = hash * 33 + (unsigned char) name[i];
+    return hash;
 }
 
 //----------------------------------------------------------------------
@@ -84,24 +161,77 @@ Directory::WriteBack(OpenFile *file)
 // 	Look up file name in directory, and return its location in the table of
 //	directory entries.  Return -1 if the name isn't in the directory.
 //
+//	We probe from the slot the name hashes to, until we find it or
+//	an entry that was never used.
+//
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
 
 int
 Directory::FindIndex(char *name)
 {
-    //printf("%s\n",name);
-    for (int i = 0; i < tableSize; i++){
-        //if(table[i].inUse==TRUE)
-            //printf("i: %d, name: %s\n",i,table[i].name);
-        //if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-         if (table[i].inUse && strcmp(table[i].name,name)==0){
-	    return i;
-         }
+    int i = HashName(name) % tableSize;
+
+    for (int probes = 0; probes < tableSize; probes++) {
+        if (table[i].inUse) {
+            if (!strncmp(table[i].name, name, FileNameMaxLen))
+                return i;
+        } else if (!table[i].deleted)
+            break;
+        i = (i + 1) % tableSize;
     }
     return -1;		// name not in directory
 }
 
+//----------------------------------------------------------------------
+// Directory::Rehash
+// 	Move the entries into a new table of "size" slots, dropping the
+//	deleted markers.  WriteBack grows the directory file to match.
+//----------------------------------------------------------------------
+
+void
+Directory::Rehash(int size)
+{
+    DirectoryEntry *oldTable = table;
+    int oldSize = tableSize;
+
+    DEBUG('f', "Rehashing directory: %d entries, %d slots -> %d\n",
+          numUsed, oldSize, size);
+    table = new DirectoryEntry[size];
+    tableSize = size;
+    bzero(table, tableSize * sizeof(DirectoryEntry));
+    numDeleted = 0;
+    firstDirty = 0;			// every entry may have moved
+    lastDirty = tableSize - 1;
+    rehashed = TRUE;
+
+    for (int j = 0; j < oldSize; j++) {
+        if (!oldTable[j].inUse)
+            continue;
+        int i = HashName(oldTable[j].name) % tableSize;
+        while (table[i].inUse)
+            i = (i + 1) % tableSize;
+        table[i] = oldTable[j];
+    }
+    delete [] oldTable;
+}
+
+//----------------------------------------------------------------------
+// Directory::RehashSize
+// 	Return the number of slots the table gets if the next Add rehashes
+//	it, as explained there; 0 if it doesn't.
+//----------------------------------------------------------------------
+
+int
+Directory::RehashSize()
+{
+    if ((numUsed + numDeleted + 1) * 4 <= tableSize * 3)
+        return 0;
+    if ((numUsed + 1) * 2 > tableSize)
+        return tableSize * 2;
+    return tableSize;
+}
+
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
@@ -124,9 +254,11 @@ Directory::Find(char *name)
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory.
+//
+//	Once used and deleted slots would fill three quarters of the
+//	table, it is rehashed: to twice the size if live entries alone
+//	take half of it, else in place to clear out the deleted ones.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
@@ -138,16 +270,24 @@ Directory::Add(char *name, int newSector)
     if (FindIndex(name) != -1)
 	return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            //table[i].name = name;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-            //printf("In add %d, name: %s sector:%d\n",i,table[i].name,table[i].sector);
-        return TRUE;
-	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    int size = RehashSize();
+    if (size > 0)
+        Rehash(size);
+
+    int i = HashName(name) % tableSize;
+    while (table[i].inUse)
+        i = (i + 1) % tableSize;
+
+    if (table[i].deleted)
+        numDeleted--;
+    numUsed++;
+    table[i].inUse = TRUE;
+    table[i].deleted = FALSE;
+    strncpy(table[i].name, name, FileNameMaxLen); 
+    table[i].name[FileNameMaxLen] = '\0';
+    table[i].sector = newSector;
+    MarkDirty(i);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -166,6 +306,10 @@ Directory::Remove(char *name)
     if (i == -1)
 	return FALSE; 		// name not in directory
     table[i].inUse = FALSE;
+    table[i].deleted = TRUE;	// keep later entries of the chain reachable
+    numUsed--;
+    numDeleted++;
+    MarkDirty(i);
     return TRUE;	
 }
 
@@ -200,13 +344,15 @@ Directory::Print()
 	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
 	    hdr->FetchFrom(table[i].sector);
 	    hdr->Print();
-           if (i>=2 && hdr->getType()==TYPE_DIR){
+           if (hdr->getType() == TYPE_DIR && strcmp(table[i].name, ".")
+                 && strcmp(table[i].name, "..")) {
                 printf("Showing content in directory %s\n",table[i].name);
                 dirFile = new OpenFile(table[i].sector);
                 sonDir = new Directory(NumDirEntries);
                 sonDir ->FetchFrom(dirFile);
                 sonDir ->Print();
                 delete sonDir;
+                delete dirFile;
            }
 	}
     printf("\n");
@@ -233,6 +379,8 @@ Directory::getSectorbyIndex(int i)
 void
 Directory::setSectorebyIndex(int i, int s)
 {
-     if(table[i].inUse==TRUE)
+     if(table[i].inUse==TRUE) {
         table[i].sector = s;
+        MarkDirty(i);
+     }
 }
\ No newline at end of file
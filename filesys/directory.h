@@ -6,6 +6,10 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The table is a hash table with open addressing, kept in the
+//	directory file as is; it doubles when it gets too full, and
+//	the directory file grows with it.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -21,7 +25,7 @@
 
 #define FileNameMaxLen 		9	// for simplicity, we assume 
 					// file names are <= 9 characters long
-#define NumDirEntries 10
+#define NumDirEntries 	16	// initial size of a directory table
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
@@ -33,6 +37,8 @@
 class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
+    bool deleted;			// Was it removed?  Lookups have to
+					//   probe past such a slot
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
@@ -64,6 +70,8 @@ class Directory {
 					// FileHeader for file: "name"
 
     bool Add(char *name, int newSector);  // Add a file name into the directory
+    int RehashSize();			// Slots the table gets if Add
+					//  rehashes it, else 0
 
     bool Remove(char *name);		// Remove a file from the directory
 
@@ -73,6 +81,8 @@ class Directory {
 					//  of the directory -- all the file
 					//  names and their contents.
     //by LMX
+    int TableSize() { return tableSize; }	// Slots to go through
+					//   with the ...byIndex calls
     char* getNamebyIndex(int i);
     int getSectorbyIndex(int i);
     void setSectorebyIndex(int i, int s);
@@ -81,9 +91,19 @@ class Directory {
     int tableSize;			// Number of directory entries
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
+    int numUsed;			// Entries in use
+    int numDeleted;			// Entries removed, but still
+					//   in the way of lookups
+    int firstDirty, lastDirty;		// Range of entries changed since
+					//   the directory was read
+    bool rehashed;			// All of them moved: write the table
+					//   to new sectors (OpenFile::Rewrite)
 
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
+    void Rehash(int size);		// Move the entries to a table
+					//  of "size" slots
+    void MarkDirty(int i);		// Entry "i" needs writing back
 };
 
 #endif // DIRECTORY_H
@@ -1,170 +1,221 @@
-#include "fileManager.h"
-
-int sectorCheck;
-Element *TempItem;
 
-bool Find;
+#include "fileManager.h"
 
+//----------------------------------------------------------------------
+// FileManager::FileManager
+// 	The table of open files: a hash table keyed by header sector.
+//	Every bucket has its own lock, which is only held to find or
+//	count a file, never across the file's I/O.
+//----------------------------------------------------------------------
 
-void CheckFile(int ptr)
+FileManager::FileManager()
 {
-    Element *element = (Element *)ptr;
-    if(element ->sector == sectorCheck){
-        Find = TRUE;
-        TempItem = element;
+    for (int i = 0; i < FileBuckets; i++) {
+        buckets[i] = NULL;
+        bucketLock[i] = new Lock("file bucket");
     }
 }
 
-void PrintInfo(int ptr)
+FileManager::~FileManager()
 {
-    Element *element = (Element *)ptr;
-    printf("sector: %d, threadcount: %d\n",element->sector,element->threadcount);
+    for (int i = 0; i < FileBuckets; i++) {
+        while (buckets[i] != NULL) {
+            Element *element = buckets[i];
+            buckets[i] = element->next;
+            delete element->lock;
+            delete element->segment;
+            delete element;
+        }
+        delete bucketLock[i];
+    }
 }
 
+//----------------------------------------------------------------------
+// FileManager::Find
+// 	Return the element of the file whose header is at "sector", or
+//	NULL.  The caller must have the file open, so that the element
+//	stays there after we release the bucket lock.
+//----------------------------------------------------------------------
 
-FileManager::FileManager()
+Element *
+FileManager::Find(int sector)
 {
-    fileList = new SynchList();
-
+    int bucket = sector % FileBuckets;
+    Element *element;
+
+    bucketLock[bucket]->Acquire();
+    for (element = buckets[bucket]; element != NULL; element = element->next)
+        if (element->sector == sector)
+            break;
+    bucketLock[bucket]->Release();
+    return element;
 }
 
-FileManager::~FileManager()
-{
-    delete fileList;
-}
+//----------------------------------------------------------------------
+// FileManager::Append
+// 	An OpenFile was created on the file at "sector".  Return TRUE if
+//	it is the first one.
+//----------------------------------------------------------------------
 
 bool
 FileManager::Append(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-   
-    fileList ->Mapcar(CheckFile); 
-
-    if(Find){   
-        TempItem ->threadcount++;
-        return FALSE;    // find the file, we don't append it 
-    }else{
-        Element *element = new Element();
-        element ->sector = sector;
-        //element ->lock = new Lock("mutex");
-        element ->lock = new Read_Write_Lock("mutex");
-        element ->threadcount = 1;
-
-        fileList ->Append(element, sector);
-        return TRUE;
-    }
+    int bucket = sector % FileBuckets;
+    Element *element;
+
+    bucketLock[bucket]->Acquire();
+    for (element = buckets[bucket]; element != NULL; element = element->next)
+        if (element->sector == sector) {
+            element->threadcount++;
+            bucketLock[bucket]->Release();
+            return FALSE;    // find the file, we don't append it
+        }
+
+    element = new Element();
+    element ->sector = sector;
+    element ->lock = new Read_Write_Lock("file");
+    element ->threadcount = 1;
+    element ->segment = NULL;
+    element ->next = buckets[bucket];
+    buckets[bucket] = element;
+    bucketLock[bucket]->Release();
+    return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileManager::Remove
+// 	An OpenFile on the file at "sector" was deleted.  Forget the
+//	file when it was the last one.
+//----------------------------------------------------------------------
+
 bool
 FileManager::Remove(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-
-    fileList ->Mapcar(CheckFile);
-
-    ASSERT(Find);
-    
-    TempItem ->threadcount--;
-    if(TempItem ->threadcount == 0){    // if the thread count equal 0, means no threads hold the file, we delete it
-        Element *element = (Element*)fileList ->RemoveByKey(sector);
-  
-        ASSERT(element != NULL);
+    int bucket = sector % FileBuckets;
+    Element **prev, *element;
+
+    bucketLock[bucket]->Acquire();
+    for (prev = &buckets[bucket]; *prev != NULL; prev = &(*prev)->next)
+        if ((*prev)->sector == sector)
+            break;
+    element = *prev;
+    ASSERT(element != NULL);
+
+    element ->threadcount--;
+    if(element ->threadcount == 0){    // if the thread count equal 0, means no threads hold the file, we delete it
+        *prev = element->next;
+        ASSERT(element->segment == NULL || element->segment->count == 0);
+        delete element->lock;
+        delete element->segment;
         delete element;
     }
+    bucketLock[bucket]->Release();
     return TRUE;
 }
 
-bool 
+//----------------------------------------------------------------------
+// FileManager::LockReadFile/ReleaseReadFile/LockWriteFile/ReleaseWriteFile
+// 	Take or give back the reader/writer lock of an open file.  Only
+//	the lookup holds the bucket lock; we may wait for the file's own
+//	lock without it.
+//----------------------------------------------------------------------
+
+bool
 FileManager::LockReadFile(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-    TempItem = NULL;
+    Element *element = Find(sector);
 
-    fileList ->Mapcar(CheckFile);
-    
-    ASSERT(Find);
-
-    ASSERT(TempItem != NULL);
-    TempItem ->lock->Read_Acquire();
+    ASSERT(element != NULL);
+    element ->lock->Read_Acquire();
 
     return TRUE;
 }
 
-bool 
+bool
 FileManager::ReleaseReadFile(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-    TempItem = NULL;
+    Element *element = Find(sector);
 
-    fileList ->Mapcar(CheckFile);
-    
-    ASSERT(Find);
-
-    ASSERT(TempItem != NULL);
-    TempItem ->lock->Read_Release();
+    ASSERT(element != NULL);
+    element ->lock->Read_Release();
 
     return TRUE;
 }
 
-bool 
+bool
 FileManager::LockWriteFile(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-    TempItem = NULL;
+    Element *element = Find(sector);
 
-    fileList ->Mapcar(CheckFile);
-    
-    ASSERT(Find);
-
-    ASSERT(TempItem != NULL);
-    TempItem ->lock->Write_Acquire();
+    ASSERT(element != NULL);
+    element ->lock->Write_Acquire();
 
     return TRUE;
 }
-bool 
+
+bool
 FileManager::ReleaseWriteFile(int sector)
 {
-    sectorCheck = sector;
-    Find = FALSE;
-    TempItem = NULL;
-
-    fileList ->Mapcar(CheckFile);
-    
-    ASSERT(Find);
+    Element *element = Find(sector);
 
-    ASSERT(TempItem != NULL);
-    TempItem ->lock ->Write_Release();
+    ASSERT(element != NULL);
+    element ->lock ->Write_Release();
 
     return TRUE;
 }
 
-int 
+//----------------------------------------------------------------------
+// FileManager::NumThread
+// 	Return how many OpenFiles there are on the file at "sector".
+//----------------------------------------------------------------------
+
+int
 FileManager::NumThread(int sector)
 {
+    int bucket = sector % FileBuckets;
+    int count = 0;
+
+    bucketLock[bucket]->Acquire();
+    for (Element *element = buckets[bucket]; element != NULL;
+                                                element = element->next)
+        if (element->sector == sector) {
+            count = element->threadcount;
+            break;
+        }
+    bucketLock[bucket]->Release();
+    return count;
+}
+
+//----------------------------------------------------------------------
+// FileManager::GetSegment
+// 	Return the segment of the open file at "sector", creating an
+//	empty one if it has none and "create" is set; else NULL.  The
+//	caller holds the file's lock.
+//----------------------------------------------------------------------
+
+LogSegment *
+FileManager::GetSegment(int sector, bool create)
+{
+    Element *element = Find(sector);
 
-    sectorCheck = sector;
-    Find = FALSE;
-    TempItem = NULL;
-
-    fileList ->Mapcar(CheckFile);
-    
-    //ASSERT(Find);          //we must find the file
-    
-    if(Find){
-        ASSERT(TempItem != NULL);
-        return TempItem ->threadcount;    
-    }else
-        return 0;
+    ASSERT(element != NULL);
+    if (element->segment == NULL && create) {
+        element->segment = new LogSegment;
+        element->segment->count = 0;
+    }
+    return element->segment;
 }
 
 void
 FileManager::Print()
 {
     printf("Printing the file list\n");
-    fileList ->Mapcar(PrintInfo);
-}
\ No newline at end of file
+    for (int i = 0; i < FileBuckets; i++) {
+        bucketLock[i]->Acquire();
+        for (Element *element = buckets[i]; element != NULL;
+                                                element = element->next)
+            printf("sector: %d, threadcount: %d\n",
+                                element->sector, element->threadcount);
+        bucketLock[i]->Release();
+    }
+}
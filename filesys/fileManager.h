@@ -1,42 +1,68 @@
 #ifndef FILEMGR_H
 #define FILEMGR_H
 
-#include "synchlist.h"
+#include "synch.h"
+#include "disk.h"
+
+#define FileBuckets	32	// hash buckets of open files, each with
+				// its own lock
+
+#define SegmentSectors	8	// data sectors rewritten before they go
+				// to the log head together
+
+// In the log-structured layout, the data sectors of a file written
+// lately and not on disk yet (see OpenFile::FlushSegment).  Shared by
+// all the OpenFiles on the file, and used under its lock.
+
+class LogSegment{
+   public:
+      int count;
+      int sectors[SegmentSectors];          // which sectors of the file
+      char data[SegmentSectors * SectorSize];
+};
 
 class Element{
    public:
       int sector;
-      int threadcount;
+      int threadcount;        // OpenFiles on the file
       Read_Write_Lock *lock;
+      LogSegment *segment;    // NULL until the file is written
+      Element *next;          // next file in the same bucket
 };
-//use the sector number as the list key
+//use the sector number of the file header as the hash key; I/O to
+//files in different buckets never waits on the same lock
 
 class FileManager
 {
      private:
-         SynchList *fileList; 
+         Element *buckets[FileBuckets];
+         Lock *bucketLock[FileBuckets];
+
+         Element *Find(int sector);    // look the file up, NULL if it
+                                       // is not open
 
      public:
-         FileManager();  
+         FileManager();
 
          ~FileManager();
- 
-         bool Append(int sector);  
+
+         bool Append(int sector);
 
          bool Remove(int sector);
-         
+
          bool LockReadFile(int sector);
 
          bool ReleaseReadFile(int sector);
-         
+
          bool LockWriteFile(int sector);
 
          bool ReleaseWriteFile(int sector);
 
          int NumThread(int sector);
 
+         LogSegment *GetSegment(int sector, bool create);
+
          void Print();
 
 };
 #endif
-
@@ -4,11 +4,13 @@
 //
 //	The file header is used to locate where on disk the 
 //	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector, 
+//	table of pointers -- the first NumDirect entries point to the
+//	disk sectors containing that portion of the file data, the next
+//	SecondDirect to index sectors listing the following data sectors,
+//	and the last one to a doubly indirect index sector, listing index
+//	sectors for the rest of the file.  The table size is chosen so
+//	that the file header will be just big enough to fit in one disk
+//	sector, 
 //
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
@@ -37,6 +39,128 @@ void FileHeader::Init(int type, int path)
     this->createTime = stats->totalTicks;
     this->path = path;
 }
+//----------------------------------------------------------------------
+// NumIndexSectors
+// 	The number of index sectors a file of "sectors" data sectors needs:
+//	one for every NumFirstDirect data sectors past the direct ones,
+//	plus the doubly indirect one once the singly indirect ones of the
+//	header are used up.
+//
+// FileHeader::NextSector
+// 	Allocate a sector for the file, as close as possible after "*last",
+//	the one allocated before: the first free sector at or after
+//	"*last" + 1.  Sectors allocated one after the other are thus
+//	consecutive on the disk whenever there is room, so reading the file
+//	in order doesn't need a seek or a rotation for each sector.
+//----------------------------------------------------------------------
+
+static int
+NumIndexSectors(int sectors)
+{
+    int indirect = sectors - NumDirect;
+
+    if (indirect <= 0)
+        return 0;
+    if (indirect <= SecondDirect * NumFirstDirect)
+        return divRoundUp(indirect, NumFirstDirect);
+    return divRoundUp(indirect, NumFirstDirect) + 1;
+}
+
+int
+FileHeader::NextSector(BitMap *freeMap, int *last)
+{
+    int sector = freeMap->FindNear(*last + 1);
+
+    if (sector != -1)
+        *last = sector;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// IndexCache::IndexCache, Invalidate
+// 	A cache of the index sectors an open file used last, so that
+//	ByteToSector only goes to the disk when a transfer moves on to
+//	the next index sector, not for every data sector.  It must be
+//	invalidated when the file grows, since that changes index sectors.
+//
+// IndexCache::Entry
+// 	Return entry "which" of index sector "sector", reading the sector
+//	in place of the least recently used one if it isn't cached.
+//----------------------------------------------------------------------
+
+IndexCache::IndexCache()
+{
+    Invalidate();
+}
+
+void
+IndexCache::Invalidate()
+{
+    for (int i = 0; i < IndexCacheSize; i++) {
+        sectors[i] = -1;
+        lastUse[i] = 0;
+    }
+    clock = 0;
+}
+
+int
+IndexCache::Entry(int sector, int which)
+{
+    int victim = 0;
+
+    for (int i = 0; i < IndexCacheSize; i++) {
+        if (sectors[i] == sector) {
+            lastUse[i] = ++clock;
+            return entries[i][which];
+        }
+        if (lastUse[i] < lastUse[victim])
+            victim = i;
+    }
+    synchDisk->ReadSector(sector, (char *) entries[victim]);
+    sectors[victim] = sector;
+    lastUse[victim] = ++clock;
+    return entries[victim][which];
+}
+
+//----------------------------------------------------------------------
+// IndexEntry
+// 	Entry "which" of index sector "sector", through "cache" if there
+//	is one.
+//
+// FreeSector, FreeIndexSector
+// 	Give back a sector of a file; or an index sector together with
+//	the first "count" data sectors it lists.
+//----------------------------------------------------------------------
+
+static int
+IndexEntry(int sector, int which, IndexCache *cache)
+{
+    int index[NumFirstDirect];
+
+    if (cache != NULL)
+        return cache->Entry(sector, which);
+    synchDisk->ReadSector(sector, (char *) index);
+    return index[which];
+}
+
+static void
+FreeSector(BitMap *freeMap, int sector)
+{
+    ASSERT(freeMap->Test(sector));  // ought to be marked!
+    freeMap->Clear(sector);
+}
+
+static void
+FreeIndexSector(BitMap *freeMap, int sector, int count)
+{
+    int index[NumFirstDirect];
+
+    synchDisk->ReadSector(sector, (char *) index);
+    for (int i = 0; i < count; i++)
+        FreeSector(freeMap, index[i]);
+    FreeSector(freeMap, sector);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -51,39 +175,25 @@ void FileHeader::Init(int type, int path)
 bool
 FileHeader::Allocate(BitMap *freeMap, int fileSize)
 { 
+    int sectors = divRoundUp(fileSize, SectorSize);
+
     numBytes = fileSize;
-    numSectors  = divRoundUp(fileSize, SectorSize);
-    int leftSectors = numSectors; 
-    if (freeMap->NumClear() < numSectors)
-	return FALSE;		// not enough space
-    //Do not need first indexes
-    if (numSectors <= NumDirect){
-        for (int i = 0; i < numSectors; i++)
-	    dataSectors[i] = freeMap->Find();
+    numSectors = 0;
+    bzero(dataSectors, sizeof(dataSectors));
+    if (fileSize <= MaxInlineSize)     // small enough to live in the header
         return TRUE;
-    }else{
-        for (int i = 0; i < NumDirect; i++)
-	    dataSectors[i] = freeMap->Find();
-        leftSectors -= NumDirect;
-    }
-    for(int i=0;leftSectors>0;i++,leftSectors-=NumFirstDirect){
-        dataSectors[NumDirect+i] = freeMap->Find();
-        //how many indexes will be used(total is 32)
-        int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-        int *firstIndex = new int[numUse];
-        for(int j=0;j<numUse;j++){
-            firstIndex[j]=freeMap->Find();
-        }
-        //Write back to the sector that contains first indexes
-        synchDisk->WriteSector(dataSectors[NumDirect+i],(char*)firstIndex);
-        delete firstIndex;
-    } 
+    if (fileSize > MaxFileSize ||
+            freeMap->NumClear() < sectors + NumIndexSectors(sectors))
+	return FALSE;		// not enough space
+    IncreaseFile(freeMap, sectors);
+    numSectors = sectors;
     return TRUE;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and the index sectors.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
@@ -91,32 +201,77 @@ FileHeader::Allocate(BitMap *freeMap, int fileSize)
 void 
 FileHeader::Deallocate(BitMap *freeMap)
 {
-    int leftSectors = numSectors;
-    if (numSectors <= NumDirect){
-        for (int i = 0; i < numSectors; i++) {
-	    ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-	    freeMap->Clear((int) dataSectors[i]);
-        }
-        return ;
-    }else{
-        for (int i = 0; i < NumDirect; i++) {
-	    ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-	    freeMap->Clear((int) dataSectors[i]);
-        }
-        leftSectors -= NumDirect;
+    int index[NumFirstDirect];
+    int leftSectors = numSectors - NumDirect;
+
+    for (int i = 0; i < numSectors && i < NumDirect; i++)
+        FreeSector(freeMap, dataSectors[i]);
+    for (int i = 0; i < SecondDirect && leftSectors > 0; i++, leftSectors -= NumFirstDirect)
+        FreeIndexSector(freeMap, dataSectors[NumDirect + i], min(leftSectors, NumFirstDirect));
+    if (leftSectors > 0) {
+        synchDisk->ReadSector(dataSectors[DoubleIndirect], (char *) index);
+        for (int i = 0; leftSectors > 0; i++, leftSectors -= NumFirstDirect)
+            FreeIndexSector(freeMap, index[i], min(leftSectors, NumFirstDirect));
+        FreeSector(freeMap, dataSectors[DoubleIndirect]);
     }
-    for(int i=0; leftSectors>0;i++,leftSectors-=NumFirstDirect){
-        int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-        char *buffer = new char[SectorSize];
-        synchDisk->ReadSector(dataSectors[NumDirect+i], buffer);
-        int *firstIndex=(int *)buffer;
-        for(int j=0;j<numUse;j++){
-           ASSERT(freeMap->Test((int) firstIndex[j]));  // ought to be marked!
-	    freeMap->Clear((int) firstIndex[j]);
-        }
-        ASSERT(freeMap->Test((int) dataSectors[NumDirect+i]));  // ought to be marked!
-	 freeMap->Clear((int) dataSectors[NumDirect+i]);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Claim
+// 	Mark the data and index sectors of the file in "used", for a
+//	check of the bitmap (see FileSystem::Check).  Print the sectors
+//	that are out of the disk, or were marked already, as another
+//	file's; return how many.
+//----------------------------------------------------------------------
+
+static int
+ClaimSector(BitMap *used, int sector)
+{
+    if (sector < 0 || sector >= NumSectors) {
+        printf("Check: sector %d is not on the disk\n", sector);
+        return 1;
+    }
+    if (used->Test(sector)) {
+        printf("Check: sector %d is in two files\n", sector);
+        return 1;
+    }
+    used->Mark(sector);
+    return 0;
+}
+
+static int
+ClaimIndexSector(BitMap *used, int sector, int count)
+{
+    int index[NumFirstDirect];
+    int errors = ClaimSector(used, sector);
+
+    if (errors > 0)
+        return errors;
+    synchDisk->ReadSector(sector, (char *) index);
+    for (int i = 0; i < count; i++)
+        errors += ClaimSector(used, index[i]);
+    return errors;
+}
+
+int
+FileHeader::Claim(BitMap *used)
+{
+    int index[NumFirstDirect];
+    int leftSectors = numSectors - NumDirect;
+    int errors = 0;
+
+    for (int i = 0; i < numSectors && i < NumDirect; i++)
+        errors += ClaimSector(used, dataSectors[i]);
+    for (int i = 0; i < SecondDirect && leftSectors > 0; i++, leftSectors -= NumFirstDirect)
+        errors += ClaimIndexSector(used, dataSectors[NumDirect + i], min(leftSectors, NumFirstDirect));
+    if (leftSectors > 0) {
+        if (ClaimSector(used, dataSectors[DoubleIndirect]) > 0)
+            return errors + 1;
+        synchDisk->ReadSector(dataSectors[DoubleIndirect], (char *) index);
+        for (int i = 0; leftSectors > 0; i++, leftSectors -= NumFirstDirect)
+            errors += ClaimIndexSector(used, index[i], min(leftSectors, NumFirstDirect));
     }
+    return errors;
 }
 
 //----------------------------------------------------------------------
@@ -155,27 +310,59 @@ FileHeader::WriteBack(int sector)
 //	data at the offset is stored).
 //
 //	"offset" is the location within the file of the byte in question
+//	"cache" keeps the index sectors read, NULL to read them every time
 //----------------------------------------------------------------------
 
 int
-FileHeader::ByteToSector(int offset)
+FileHeader::ByteToSector(int offset, IndexCache *cache)
 {
     int sectorIndex = offset / SectorSize;
-    if(sectorIndex < NumDirect)
-        return(dataSectors[sectorIndex]);
-    else{
-        sectorIndex-=NumDirect;
-        for(int i=0;sectorIndex>=0;i++,sectorIndex-=NumFirstDirect){
-            if(sectorIndex<NumFirstDirect){
-                char *buffer = new char[SectorSize];
-                synchDisk->ReadSector(dataSectors[NumDirect+i], buffer);
-                int *firstIndex = (int *)buffer;
-                int sector = firstIndex[sectorIndex];
-                delete buffer;
-                return sector;
-            }
-        }
+
+    if (sectorIndex < NumDirect)
+        return dataSectors[sectorIndex];
+    sectorIndex -= NumDirect;
+    if (sectorIndex < SecondDirect * NumFirstDirect)
+        return IndexEntry(dataSectors[NumDirect + sectorIndex / NumFirstDirect],
+                          sectorIndex % NumFirstDirect, cache);
+    sectorIndex -= SecondDirect * NumFirstDirect;
+    return IndexEntry(IndexEntry(dataSectors[DoubleIndirect],
+                                 sectorIndex / NumFirstDirect, cache),
+                      sectorIndex % NumFirstDirect, cache);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Relocate
+// 	Point data sector "sectorIndex" of the file to "newSector", which
+//	already holds its contents, and return the sector it replaces.
+//	An index sector that changes is written back; the header itself
+//	is up to the caller.
+//----------------------------------------------------------------------
+
+int
+FileHeader::Relocate(int sectorIndex, int newSector)
+{
+    int index[NumFirstDirect];
+    int indexSector, old;
+
+    ASSERT(sectorIndex < numSectors);
+    if (sectorIndex < NumDirect) {
+        old = dataSectors[sectorIndex];
+        dataSectors[sectorIndex] = newSector;
+        return old;
+    }
+    sectorIndex -= NumDirect;
+    if (sectorIndex < SecondDirect * NumFirstDirect)
+        indexSector = dataSectors[NumDirect + sectorIndex / NumFirstDirect];
+    else {
+        sectorIndex -= SecondDirect * NumFirstDirect;
+        indexSector = IndexEntry(dataSectors[DoubleIndirect],
+                                 sectorIndex / NumFirstDirect, NULL);
     }
+    synchDisk->ReadSector(indexSector, (char *) index);
+    old = index[sectorIndex % NumFirstDirect];
+    index[sectorIndex % NumFirstDirect] = newSector;
+    synchDisk->WriteSector(indexSector, (char *) index);
+    return old;
 }
 
 //----------------------------------------------------------------------
@@ -198,42 +385,29 @@ FileHeader::FileLength()
 void
 FileHeader::Print()
 {
-    int i;
+    int i, j, k;
+    char *data = new char[SectorSize];
+    IndexCache cache;
+
     printf("type:%d, createTime: %d, accessTime: %d, modifyTime: %d\n", type, createTime, accessTime, modifyTime);
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-    int leftSectors = numSectors;
-    if(numSectors<NumDirect){
-        printf("Direct indexes:\n");
-        for (i = 0; i < numSectors; i++)
-	    printf("%d ", dataSectors[i]);
-        printf("\n");
-        leftSectors=0;
-    }else{
-        printf("Direct indexes:\n");
-        for (i = 0; i < NumDirect; i++)
-	    printf("%d ", dataSectors[i]);
-        printf("\n");
-        leftSectors -= NumDirect;
-    }
-    for(int i=0; leftSectors>0;i++,leftSectors-=NumFirstDirect){
-        int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-        char *buffer = new char[SectorSize];
-        synchDisk->ReadSector(dataSectors[NumDirect+i], buffer);
-        int *firstIndex=(int *)buffer;
-        printf("First indexes: %d\n",dataSectors[NumDirect+i]);
-        printf("Direct indexes of the first index:\n");
-        for(int j=0;j<numUse;j++){
-            printf("%d ",firstIndex[j]);
-        }
-        printf("\n");
-    }
+    if (numSectors == 0)
+        printf("(inline)");
+    for (i = 0; i < numSectors; i++)
+        printf("%d ", ByteToSector(i * SectorSize, &cache));
+    printf("\nIndex sectors:\n");
+    for (i = 0; i < SecondDirect && NumDirect + i * NumFirstDirect < numSectors; i++)
+        printf("%d ", dataSectors[NumDirect + i]);
+    if (numSectors > NumDirect + SecondDirect * NumFirstDirect)
+        printf("%d (doubly indirect)", dataSectors[DoubleIndirect]);
+    printf("\n");
 
-    
-    int j, k;
-    char *data = new char[SectorSize];
     printf("\nFile contents:\n");
-    for (i = k = 0; i < numSectors; i++) {
-	synchDisk->ReadSector(dataSectors[i], data);
+    for (i = k = 0; k < numBytes; i++) {
+        if (numSectors == 0)
+            bcopy(InlineData(), data, numBytes);
+        else
+            synchDisk->ReadSector(ByteToSector(i * SectorSize, &cache), data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
 	    if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
 		printf("%c", data[j]);
@@ -243,10 +417,8 @@ FileHeader::Print()
         printf("\n"); 
     }
     delete [] data;
-    
 }
 
-//by LMX
 //----------------------------------------------------------------------
 // FileHeader::ChangeSize
 //     Reset the size of the file, this function is used when we increase the size of the file
@@ -257,10 +429,24 @@ FileHeader::ChangeSize(BitMap *freeMap, int newSize)
 {  
      int newSectorNum = divRoundUp(newSize, SectorSize);
      ASSERT(newSectorNum >= numSectors)
-     if(newSize > MaxFileSize || (freeMap ->NumClear()) < (newSectorNum - numSectors))
+     if(newSize > MaxFileSize || (freeMap ->NumClear()) <
+            (newSectorNum + NumIndexSectors(newSectorNum) - numSectors - NumIndexSectors(numSectors)))
         return FALSE;
 
-     if(numSectors == newSectorNum){    //if the accural disk sector remain same, do nothing                               
+     if(numSectors == 0 && newSize <= MaxInlineSize){     //still fits in the header
+         numBytes = newSize;
+     }else if(numSectors == newSectorNum){    //if the accural disk sector remain same, do nothing                               
+         numBytes = newSize;
+     }else if(numSectors == 0){     //inline data moves out to the first data sector
+         char *buffer = new char[SectorSize];
+         bzero(buffer, SectorSize);
+         bcopy((char *)dataSectors, buffer, numBytes);
+         bzero(dataSectors, sizeof(dataSectors));
+         IncreaseFile(freeMap, newSectorNum);
+         if(numBytes > 0)
+             synchDisk->WriteSector(dataSectors[0], buffer);
+         delete [] buffer;
+         numSectors = newSectorNum;
          numBytes = newSize;
      }else{
          IncreaseFile(freeMap, newSectorNum - numSectors);
@@ -270,95 +456,68 @@ FileHeader::ChangeSize(BitMap *freeMap, int newSize)
      return TRUE;
 }
 
+
 //----------------------------------------------------------------------
 // FileHeader::IncreaseFile
 // 	
 //     Increase the size of the file, more precisely, increase the number of disk sectors 
 //      allocated for that files
 //
+//     The index sectors are filled in memory and each is written once,
+//     when the next one is started and at the end.
 //----------------------------------------------------------------------
 
 void
 FileHeader::IncreaseFile(BitMap *freeMap, int newSectors)
 {
-     if (numSectors+newSectors<=NumDirect){ //Increased file can also just use first indexes
-            for(int i=0;i<newSectors;i++)
-                dataSectors[numSectors+i]=freeMap->Find();
-     }else if(numSectors<=NumDirect){   //Original file just use first indexes, but now we need second indexes
-            int leftDirectSectors = NumDirect-numSectors;
-            for(int i=0;i<leftDirectSectors;i++)
-                dataSectors[numSectors+i]=freeMap->Find();
-            
-            //other sectors need first indexes!
-            int leftSectors = newSectors-leftDirectSectors;
-            for(int i=0;leftSectors>0;i++,leftSectors-=NumFirstDirect){
-                dataSectors[NumDirect+i] = freeMap->Find();
-                //how many indexes will be used(total is 32)
-                int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-                int *firstIndex = new int[numUse];
-                for(int j=0;j<numUse;j++)
-                    firstIndex[j]=freeMap->Find();
-                
-                //Write back to the sector that contains first indexes
-                synchDisk->WriteSector(dataSectors[NumDirect+i],(char*)firstIndex);
-                delete firstIndex;
-            }
-     }else{ //Original file has already used first indexes!
-        int lastLeftSectors = numSectors-NumDirect;
-        if(lastLeftSectors%NumFirstDirect==0){  //Original file has exactly used up direct indexes in its first indexes
-            int lastFreeFirstIndex = lastLeftSectors/NumFirstDirect + NumDirect;
-            int leftSectors = newSectors;
-            
-            for(int i=0;leftSectors>0;i++,leftSectors-=NumFirstDirect){
-                dataSectors[lastFreeFirstIndex+i] = freeMap->Find();
-                //how many indexes will be used(total is 32)
-                int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-                int *firstIndex = new int[numUse];
-                for(int j=0;j<numUse;j++)
-                    firstIndex[j]=freeMap->Find();
-                
-                //Write back to the sector that contains first indexes
-                synchDisk->WriteSector(dataSectors[lastFreeFirstIndex+i],(char*)firstIndex);
-                delete firstIndex;
-            }
-        }else{  //There are free direct indexes in the last first index of original file
-            int usedDirectIndex = lastLeftSectors%NumFirstDirect;
-            int lastFreeFirstIndex = lastLeftSectors/NumFirstDirect + NumDirect;
-            int leftSectors = newSectors;
-            //read out the last direct index
-            char *buffer = new char[SectorSize];
-            synchDisk->ReadSector(dataSectors[lastFreeFirstIndex], buffer);
-            int *firstIndex=(int *)buffer;
-            
-            if(newSectors+usedDirectIndex<=NumFirstDirect){  // This first index is enough
-                for(int i=0;i<newSectors;i++)
-                    firstIndex[usedDirectIndex+i]=freeMap->Find();
-                //Write back to the sector that contains first indexes
-                synchDisk->WriteSector(dataSectors[lastFreeFirstIndex],(char*)firstIndex);
-                delete buffer;
-            }else{  //Still need new first index!
-                for(int i=0;usedDirectIndex+i<NumFirstDirect;i++)
-                    firstIndex[usedDirectIndex+i]=freeMap->Find();
-                //Write back to the sector that contains first indexes
-                synchDisk->WriteSector(dataSectors[lastFreeFirstIndex],(char*)firstIndex);
-                delete buffer;
-                
-                leftSectors-=(NumFirstDirect-usedDirectIndex);
-                lastFreeFirstIndex++;
-                 
-                for(int i=0;leftSectors>0;i++,leftSectors-=NumFirstDirect){
-                    dataSectors[lastFreeFirstIndex+i] = freeMap->Find();
-                    //how many indexes will be used(total is 32)
-                    int numUse = leftSectors<NumFirstDirect?leftSectors:NumFirstDirect;
-                    int *firstIndex = new int[numUse];
-                    for(int j=0;j<numUse;j++)
-                        firstIndex[j]=freeMap->Find();
-                
-                    //Write back to the sector that contains first indexes
-                    synchDisk->WriteSector(dataSectors[lastFreeFirstIndex+i],(char*)firstIndex);
-                    delete firstIndex;
-                }
-            }
-        }
+     int single[NumFirstDirect];        // the index sector being filled
+     int dbl[NumFirstDirect];           // and the doubly indirect one
+     int singleSector = -1;
+     bool singleDirty = FALSE, dblRead = FALSE, dblDirty = FALSE;
+     // the new sectors go right after the end of the file, if possible
+     int last = (numSectors > 0) ? ByteToSector((numSectors - 1) * SectorSize)
+                : freeMap->FindRun(newSectors + NumIndexSectors(newSectors)) - 1;
+
+     for (int i = numSectors; i < numSectors + newSectors; i++) {
+         if (i < NumDirect) {
+             dataSectors[i] = NextSector(freeMap, &last);
+             continue;
+         }
+         int k = i - NumDirect;         // which sector behind an index sector
+         int slot = k % NumFirstDirect;
+         int *where;                    // where its index sector is listed
+         if (k < SecondDirect * NumFirstDirect) {
+             where = &dataSectors[NumDirect + k / NumFirstDirect];
+         } else {
+             k -= SecondDirect * NumFirstDirect;
+             if (k == 0) {      // first use of the doubly indirect sector
+                 dataSectors[DoubleIndirect] = NextSector(freeMap, &last);
+                 bzero(dbl, sizeof(dbl));
+                 dblRead = TRUE;
+             } else if (!dblRead) {
+                 synchDisk->ReadSector(dataSectors[DoubleIndirect], (char *) dbl);
+                 dblRead = TRUE;
+             }
+             where = &dbl[k / NumFirstDirect];
+             if (slot == 0)
+                 dblDirty = TRUE;
+         }
+         if (slot == 0)         // start a new index sector
+             *where = NextSector(freeMap, &last);
+         if (*where != singleSector) {
+             if (singleDirty)
+                 synchDisk->WriteSector(singleSector, (char *) single);
+             if (slot == 0)
+                 bzero(single, sizeof(single));
+             else
+                 synchDisk->ReadSector(*where, (char *) single);
+             singleSector = *where;
+         }
+         single[slot] = NextSector(freeMap, &last);
+         singleDirty = TRUE;
      }
+     if (singleDirty)
+         synchDisk->WriteSector(singleSector, (char *) single);
+     if (dblDirty)
+         synchDisk->WriteSector(dataSectors[DoubleIndirect], (char *) dbl);
 }
@@ -19,19 +19,26 @@
 
 
 #define SecondDirect 5
-#define NumDirect 	((SectorSize - 7 * sizeof(int) - SecondDirect * sizeof(int)) / sizeof(int))
-#define NumFirstDirect (SectorSize/sizeof(int))    //each second index can have 32 first indexes
-#define TotalDirect (NumDirect+SecondDirect*NumFirstDirect)
-#define TotalEntry (NumDirect+SecondDirect)
+#define NumDirect 	((int) ((SectorSize - 7 * sizeof(int) - (SecondDirect + 1) * sizeof(int)) / sizeof(int)))
+#define NumFirstDirect ((int) (SectorSize/sizeof(int)))    //each second index can have 32 first indexes
+#define TotalDirect (NumDirect+SecondDirect*NumFirstDirect+NumFirstDirect*NumFirstDirect)
+#define TotalEntry (NumDirect+SecondDirect+1)
+#define DoubleIndirect (NumDirect+SecondDirect)     //entry of the doubly indirect index
 #define MaxFileSize 	(TotalDirect * SectorSize)
+#define MaxInlineSize	((int) (TotalEntry * sizeof(int)))	// bytes kept in the header
+
+#define IndexCacheSize	4
 
 #define TYPE_FILE 0
 #define TYPE_DIR 1
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks. 
+// The file header is organized as a table of pointers to data blocks:
+// NumDirect of them point to data blocks, SecondDirect to index blocks
+// of NumFirstDirect data block pointers each, and the last one to a
+// doubly indirect block of NumFirstDirect index block pointers, which
+// is enough for a file to span the disk.
 //
 // The file header data structure can be stored in memory or on disk.
 // When it is on disk, it is stored in a single sector -- this means
@@ -39,10 +46,30 @@
 // as one disk sector.  Without indirect addressing, this
 // limits the maximum file length to just under 4K bytes.
 //
+// A file of at most MaxInlineSize bytes has no data sectors at all: its
+// bytes are kept in the header sector, in place of the table, so
+// reading it takes no disk access besides the header.  It is moved
+// out to data sectors when it grows beyond that.
+//
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
 // reading it from disk.
 
+// The index sectors an open file read last (see FileHeader::ByteToSector).
+
+class IndexCache {
+  public:
+    IndexCache();
+    int Entry(int sector, int which);	// Entry "which" of index sector "sector"
+    void Invalidate();			// Forget everything, the index changed
+
+  private:
+    int sectors[IndexCacheSize];	// Index sectors cached, -1 if none
+    int entries[IndexCacheSize][NumFirstDirect];
+    int lastUse[IndexCacheSize];
+    int clock;
+};
+
 class FileHeader {
   public:
     bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
@@ -50,14 +77,21 @@ class FileHeader {
 						//  on disk for the file data
     void Deallocate(BitMap *bitMap);  		// De-allocate this file's 
 						//  data blocks
+    int Claim(BitMap *used);			// Mark them in "used", for a
+						//  check; return the errors
 
     void FetchFrom(int sectorNumber); 	// Initialize file header from disk
     void WriteBack(int sectorNumber); 	// Write modifications to file header
 					//  back to disk
 
-    int ByteToSector(int offset);	// Convert a byte offset into the file
+    int ByteToSector(int offset, IndexCache *cache = NULL);
+					// Convert a byte offset into the file
 					// to the disk sector containing
 					// the byte
+    int Relocate(int sectorIndex, int newSector);
+    					// Make data sector "sectorIndex" of
+					// the file be "newSector"; return
+					// the one it was
 
     int FileLength();			// Return the length of the file 
 					// in bytes
@@ -70,10 +104,15 @@ class FileHeader {
     bool ChangeSize(BitMap * freeMap, int newSize);
     void IncreaseFile(BitMap * freeMap, int newSectors);
     int getType(){return type;}
+    bool IsInline(){return numSectors == 0;}	// data kept in the header?
+    char *InlineData(){return (char *)dataSectors;}
     int getPath(){return path;}
     void setPath(int p){path=p;}
 
   private:
+    int NextSector(BitMap *freeMap, int *last);	// Allocate a data or index
+						// sector after "*last"
+
     int numBytes;			// Number of bytes in the file
     int numSectors;			// Number of data sectors in the file
     //int dataSectors[NumDirect];		// Disk sector numbers for each data 
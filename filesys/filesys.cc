@@ -23,10 +23,16 @@
 //
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	are written back to disk (the two files are kept open during all
+//	this time), as one transaction of the journal (cf. journal.h):
+//	after a crash the file system has all of them or none.  If the
+//	operation fails, and we have modified part of the directory, we
+//	simply discard the changed version, without writing it back to disk.
+//
+//	The bitmap is only read from disk when the file system starts: it
+//	stays in memory, under a lock, and an operation undoes its own
+//	changes to it if it fails.  Only the sectors of the bitmap file
+//	that changed are written back.
 //
 // 	Our implementation at this point has the following restrictions:
 //
@@ -48,8 +54,11 @@
 #include "disk.h"
 #include "bitmap.h"
 #include "directory.h"
+#include "dentryCache.h"
+#include "journal.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "synch.h"
 #include "system.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
@@ -58,11 +67,9 @@
 #define FreeMapSector 		0
 #define DirectorySector 	1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
+// Initial file sizes for the bitmap and directory; a directory file
+// grows as files are added to it.
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define NumDirEntries 		10
 #define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
 
 
@@ -82,7 +89,7 @@ void RecursiveDelete(char *path)
     Directory *directory = new Directory(NumDirEntries);
     directory ->FetchFrom(dirFile);
 
-    for(int i = 2; i < NumDirEntries; i++)
+    for(int i = 0; i < directory ->TableSize(); i++)
     {
         int old_sector = directory ->getSectorbyIndex(i);     //the head sector of the correspond file.
         if(old_sector == -1)
@@ -90,6 +97,8 @@ void RecursiveDelete(char *path)
 
         char *filename = directory ->getNamebyIndex(i);
         ASSERT(filename != NULL);
+        if(!strcmp(filename, ".") || !strcmp(filename, ".."))
+           continue;
 
         FileHeader *hdr = new FileHeader;
         hdr ->FetchFrom(old_sector);
@@ -121,13 +130,19 @@ void RecursiveDelete(char *path)
 //	representing the bitmap and the directory.
 //
 //	"format" -- should we initialize the disk?
+//	"lfs" -- when formatting, should file data be written
+//		log-structured (cf. WriteToLog)?  Else the disk says.
 //----------------------------------------------------------------------
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, bool lfs)
 { 
     DEBUG('f', "Initializing the file system.\n");
+    freeMap = new BitMap(NumSectors);
+    diskFreeMap = new BitMap(NumSectors);
+    freeMapLock = new Lock("free map");
+    dentryCache = new DentryCache;
+    journal = new Journal(JournalStartSector, JournalSectors);
     if (format) {
-        BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
 	FileHeader *mapHdr = new FileHeader;
 	FileHeader *dirHdr = new FileHeader;
@@ -139,6 +154,12 @@ FileSystem::FileSystem(bool format)
 	freeMap->Mark(FreeMapSector);	    
 	freeMap->Mark(DirectorySector);
 
+    // Neither are the swap area at the end of the disk, and the
+    // journal before it
+	for (int i = JournalStartSector; i < NumSectors; i++)
+	    freeMap->Mark(i);
+	journal->Format(lfs ? LogStructuredFlag : 0);
+
     // Second, allocate space for the data blocks containing the contents
     // of the directory and bitmap files.  There better be enough space!
 
@@ -182,99 +203,465 @@ FileSystem::FileSystem(bool format)
 	if (DebugIsEnabled('f')) {
 	    freeMap->Print();
 	    directory->Print();
-
-        delete freeMap; 
+	}
 	delete directory; 
 	delete mapHdr; 
 	delete dirHdr;
-	}
     } else {
-    // if we are not formatting the disk, just open the files representing
+    // if we are not formatting the disk, first finish the operations
+    // a crash may have cut short, then just open the files representing
     // the bitmap and directory; these are left open while Nachos is running
+        journal->Recover();
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap->FetchFrom(freeMapFile);
+    }
+    diskFreeMap->FetchFrom(freeMapFile);
+    synchDisk->SetJournal(journal);
+    logStructured = (journal->Flags() & LogStructuredFlag) != 0;
+    logHead = 0;
+    replaced = new class List;
+    replacedMap = new BitMap(NumSectors);
+    DEBUG('f', "File data is written %s.\n",
+          logStructured ? "log-structured" : "in place");
+}
+
+//----------------------------------------------------------------------
+// FileSystem::~FileSystem
+// 	Nachos is halting.  Everything has been synced (see Cleanup), so
+//	the journal has nothing left to lose.
+//----------------------------------------------------------------------
+
+FileSystem::~FileSystem()
+{
+    synchDisk->SetJournal(NULL);
+    delete journal;
+    ASSERT(replaced->IsEmpty());
+    delete replaced;
+    delete replacedMap;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteToLog
+// 	Write "count" data sectors of a file, the sectors "sectors" of
+//	it, as one run at the log head instead of in place.  Small writes
+//	all over a file become sequential writes, close to one another on
+//	disk: OpenFile collects them into a segment of up to
+//	SegmentSectors before it calls us (cf. OpenFile::FlushSegment),
+//	so the header, index and bitmap sectors changed are journaled
+//	once for the whole segment.
+//
+//	The header stays where it is: being at a fixed sector, it serves
+//	as the inode map.  The sectors replaced are garbage at once, so
+//	there is nothing for a cleaner to do; the log head just goes on
+//	to the next free run, wrapping around the disk.  They are free
+//	on disk with the transaction switching the file over, but nobody
+//	gets them before it is logged: after a crash the file could be
+//	back on them (see ReleaseReplaced).
+//
+//	Return FALSE if the data has to be written in place: LogsData
+//	says no, another OpenFile is open on the file, or no run of
+//	"count" free sectors is left.
+//
+//	Only the caller's header learns the new sectors, so with another
+//	OpenFile on the file (an executable, a mapping) we can't move
+//	them: that one would go on using the freed sectors, and write its
+//	old header back over ours.  The caller holds the file's write
+//	lock, and a new OpenFile reads the header under the read lock,
+//	after it is counted, so none can come in while we move them.
+//
+//	"hdr", "headSector" -- the header of the file, and where it goes
+//	"data" -- the new contents of the sectors, one after the other
+//----------------------------------------------------------------------
+
+bool
+FileSystem::WriteToLog(FileHeader *hdr, int headSector, int *sectors,
+		int count, char *data)
+{
+    int start, group, *old;
+
+    if (!LogsData(hdr, headSector) || fileManager->NumThread(headSector) > 1)
+        return FALSE;
+
+    freeMapLock->Acquire();
+    start = freeMap->FindRun(count, logHead);
+    if (start != -1) {
+        for (int i = 0; i < count; i++)
+            freeMap->Mark(start + i);
+        logHead = start + count;
+    }
+    freeMapLock->Release();
+    if (start == -1)
+        return FALSE;
+
+    DEBUG('f', "Writing %d sectors of file %d at %d\n", count, headSector,
+          start);
+    for (int i = 0; i < count; i++)		// one sequential run
+        synchDisk->WriteSector(start + i, &data[i * SectorSize]);
+
+    // Now switch the file over to them, all at once
+    old = new int[count];
+    journal->Begin();
+    group = journal->NextGroup();
+    for (int i = 0; i < count; i++)
+        old[i] = hdr->Relocate(sectors[i], start + i);
+    hdr->WriteBack(headSector);
+
+    freeMapLock->Acquire();
+    ReleaseReplaced(FALSE);			// those logged by now
+    for (int i = 0; i < count; i++) {
+        replaced->Append((void *) old[i], group);
+        replacedMap->Mark(old[i]);
+    }
+    FlushFreeMap();
+    freeMapLock->Release();
+    journal->End();
+    delete [] old;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RewriteFile
+// 	Write the file, from the start, with "numBytes" from "data" (whole
+//	sectors), to sectors nothing refers to, then switch the file over
+//	to them in the transaction the caller is in.  The data is not
+//	logged, so rewriting a whole directory table after a rehash takes
+//	a few sectors of the log, not the table, which could be bigger
+//	than the log: the header, the index sectors, the bitmap.
+//
+//	The sectors the file has are copied to new ones, and freed once
+//	that is logged, as for WriteToLog; those it grows by are new
+//	already.  So the disk needs room for the old table and the new
+//	one together (see RoomToAdd).
+//
+//	The caller's transaction must not have freed sectors yet (see
+//	Journal::WriteFresh); Create hasn't.  Return FALSE if there is
+//	no room.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::RewriteFile(FileHeader *hdr, int headSector, char *data,
+		int numBytes)
+{
+    int count = divRoundUp(numBytes, SectorSize);
+    int moved = min(divRoundUp(hdr->FileLength(), SectorSize), count);
+    int *fresh, group, i;
+
+    journal->Settle();			// no free sector is in use on disk
+    freeMapLock->Acquire();
+    ReleaseReplaced(FALSE);		// all logged now
+    freeMapLock->Release();
+    if (numBytes > hdr->FileLength() && !ChangeFileSize(hdr, numBytes))
+        return FALSE;
+
+    fresh = new int[moved];
+    freeMapLock->Acquire();
+    for (i = 0; i < moved; i++)
+        if ((fresh[i] = freeMap->Find()) == -1)
+            break;
+    if (i < moved) {
+        while (--i >= 0)
+            freeMap->Clear(fresh[i]);
+        freeMapLock->Release();
+        delete [] fresh;
+        return FALSE;
+    }
+    freeMapLock->Release();
+
+    DEBUG('f', "Rewriting %d sectors of file %d, %d of them moved\n",
+          count, headSector, moved);
+    for (i = 0; i < count; i++)
+        journal->WriteFresh(i < moved ? fresh[i]
+                                : hdr->ByteToSector(i * SectorSize),
+                            &data[i * SectorSize]);
+    group = journal->NextGroup();
+    for (i = 0; i < moved; i++)
+        fresh[i] = hdr->Relocate(i, fresh[i]);	// now the old ones
+    hdr->WriteBack(headSector);
+
+    freeMapLock->Acquire();
+    for (i = 0; i < moved; i++) {
+        replaced->Append((void *) fresh[i], group);
+        replacedMap->Mark(fresh[i]);
+    }
+    FlushFreeMap();
+    freeMapLock->Release();
+    delete [] fresh;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RoomToAdd
+// 	Return TRUE if there is room on disk to add a file of "size"
+//	bytes to "directory": if the table is rehashed for it, the new
+//	table goes to new sectors (see RewriteFile) before the file gets
+//	its own.  The caller holds the free map lock, and has taken the
+//	header sector already.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::RoomToAdd(Directory *directory, int size)
+{
+    int table = divRoundUp(directory->RehashSize() * sizeof(DirectoryEntry),
+                           SectorSize);
+    int data = divRoundUp(size, SectorSize);
+
+    if (table == 0)
+        return TRUE;			// Allocate checks the rest
+    return freeMap->NumClear() >= table + divRoundUp(table, NumFirstDirect) + 1
+                                + data + divRoundUp(data, NumFirstDirect) + 1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LogsData
+// 	Return TRUE if the data sectors of the file whose header is "hdr",
+//	at "headSector", go to the log head when they are written.  Not
+//	if the disk is not log-structured, nor for the bitmap and the
+//	directories: they are written under the locks WriteToLog takes,
+//	and must be on disk when the operation writing them ends.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::LogsData(FileHeader *hdr, int headSector)
+{
+    return logStructured && headSector != FreeMapSector
+           && hdr->getType() == TYPE_FILE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseReplaced
+// 	Free the data sectors WriteToLog replaced, once the journal group
+//	that moved their file off them is logged ("all": all of them,
+//	when everything is).  Until then they are marked in "freeMap",
+//	so they are not allocated, and in "replacedMap", so they are
+//	written free to disk (see FlushFreeMap): the bitmap on disk
+//	always goes with the headers there.  The caller holds the free
+//	map lock.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReleaseReplaced(bool all)
+{
+    int group;
+
+    while (!replaced->IsEmpty()) {
+        int sector = (int) replaced->SortedRemove(&group);
+        if (!all && group >= journal->NextGroup()) {
+            replaced->Prepend((void *) sector, group);	// not logged yet
+            return;
+        }
+        freeMap->Clear(sector);
+        replacedMap->Clear(sector);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::BeginOperation/EndOperation
+// 	Bracket a change to the file system that must reach the disk as
+//	a whole, such as growing a file and writing back its header.
+//	Create, Remove and the others do it themselves.
+//----------------------------------------------------------------------
+
+void
+FileSystem::BeginOperation()
+{
+    journal->Begin();
+}
+
+void
+FileSystem::EndOperation()
+{
+    journal->End();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Write everything the journal holds in place.  Until then, the
+//	last few operations may be lost in a crash (group commit); but
+//	the file system is consistent either way.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Sync()
+{
+    journal->Sync();
+    freeMapLock->Acquire();
+    ReleaseReplaced(TRUE);		// all logged now
+    freeMapLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check that the bitmap on disk marks the sectors in use, and
+//	nothing else: the headers of the files reachable from the root
+//	directory, with their index and data sectors, those of the
+//	bitmap file, and the journal and swap areas.  Print what is
+//	wrong; return TRUE if nothing is.  Meant for a disk just
+//	recovered from a crash (see CrashTest).
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Check()
+{
+    BitMap *used = new BitMap(NumSectors);
+    int errors = 0;
+
+    for (int i = JournalStartSector; i < NumSectors; i++)
+        used->Mark(i);
+    errors += CheckFile(FreeMapSector, used);
+    errors += CheckFile(DirectorySector, used);
+
+    freeMapLock->Acquire();
+    for (int i = 0; i < NumSectors; i++)
+        if (used->Test(i) && !diskFreeMap->Test(i)) {
+            printf("Check: sector %d is in use, but free\n", i);
+            errors++;
+        } else if (!used->Test(i) && diskFreeMap->Test(i)) {
+            printf("Check: sector %d is in no file, but marked\n", i);
+            errors++;
+        }
+    freeMapLock->Release();
+    delete used;
+
+    if (errors == 0)
+        printf("Check: the bitmap matches the files\n");
+    else
+        printf("Check: %d errors\n", errors);
+    return errors == 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CheckFile
+// 	Mark the header at "sector" in "used", with its index and data
+//	sectors; if it is a directory, the files in it too.  Print the
+//	sectors found twice; return how many.
+//----------------------------------------------------------------------
+
+int
+FileSystem::CheckFile(int sector, BitMap *used)
+{
+    FileHeader *hdr;
+    int errors;
+
+    if (sector < 0 || sector >= NumSectors || used->Test(sector)) {
+        printf("Check: header %d is not on the disk, or in use\n", sector);
+        return 1;
+    }
+    used->Mark(sector);
+    hdr = new FileHeader;
+    hdr->FetchFrom(sector);
+    errors = hdr->Claim(used);
+
+    if (hdr->getType() == TYPE_DIR && errors == 0) {
+        OpenFile *dirFile = new OpenFile(sector);
+        Directory *directory = new Directory(NumDirEntries);
+
+        directory->FetchFrom(dirFile);
+        for (int i = 0; i < directory->TableSize(); i++) {
+            char *name = directory->getNamebyIndex(i);
+            if (name == NULL || !strcmp(name, ".") || !strcmp(name, ".."))
+                continue;
+            errors += CheckFile(directory->getSectorbyIndex(i), used);
+        }
+        delete directory;
+        delete dirFile;
+    }
+    delete hdr;
+    return errors;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FlushFreeMap
+// 	Write the changes to the bitmap of free sectors back to disk,
+//	only the sectors of the bitmap file that differ from what is on
+//	disk.  The sectors waiting in "replacedMap" are free there.  The
+//	caller holds "freeMapLock".
+//----------------------------------------------------------------------
+
+void
+FileSystem::FlushFreeMap()
+{
+    ASSERT(freeMapLock->isHeldByCurrentThread());
+    freeMap->WriteChanges(freeMapFile, diskFreeMap, replacedMap);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupEntry
+// 	Look up "name" in the directory whose header is at "dirSector".
+//	Return the sector of its header, -1 if there is no such file, and
+//	set "type" to the type of the file.
+//
+//	The answer comes from the dentry cache if it is there; else we
+//	read the directory and the file header, and cache what we found.
+//----------------------------------------------------------------------
+
+int
+FileSystem::LookupEntry(int dirSector, char *name, int *type)
+{
+    int sector;
+
+    if (dentryCache->Lookup(dirSector, name, &sector, type))
+        return sector;
+
+    OpenFile *dirFile = new OpenFile(dirSector);
+    Directory *directory = new Directory(NumDirEntries);
+    directory->FetchFrom(dirFile);
+    sector = directory->Find(name);
+    delete directory;
+    delete dirFile;
+
+    *type = TYPE_FILE;
+    if (sector != -1) {
+        FileHeader *hdr = new FileHeader;
+        hdr->FetchFrom(sector);
+        *type = hdr->getType();
+        delete hdr;
     }
+    dentryCache->Enter(dirSector, name, sector, *type);
+    return sector;
 }
 
 //---------------------------------------------------------------------
 //FileSystem::FindFile(char *path)
 //       Give a path, find the file header sector of that path
+//       Each name is looked up through the dentry cache, so a path
+//       used recently is found without reading any directory.
 //---------------------------------------------------------------------
 
 int
 FileSystem::FindFile(const char *strpath)
 {
-    OpenFile *dirFile;
-    Directory *directory;
-    int sector;
+    int sector, type;
+    bool absolute;
     char *tokenPtr, path[0x100];
  
     if(strpath == NULL)
        return -1;
 
     strncpy(path, strpath, 0x100);
-    if(path[0] == '/'){      // root directory
-        dirFile = new OpenFile(DirectorySector);   // we don't need write back, since we will not change it.
-        directory = new Directory(NumDirEntries);
-        directory ->FetchFrom(dirFile);
-        
+    absolute = (path[0] == '/');
+    if(absolute)
         sector = DirectorySector;  // the root directory sector
-
-        tokenPtr = strtok(path, "/");
-        while(tokenPtr != NULL){
-             delete dirFile;     
-             //printf("%s\n",tokenPtr);
-             sector = directory ->Find(tokenPtr);   //find in the current directory
-             if(sector == -1){
-                printf("Failed to find the directory/file %s in current directory\n", tokenPtr);
-                return -1;
-             }
-
-             tokenPtr = strtok(NULL, "/"); 
-             dirFile = new OpenFile(sector);
-             
-             if(tokenPtr != NULL){
-                 if(dirFile ->FileType() == TYPE_FILE){   //this is a file, not a directory
-                      printf("Current file is a file type, not a directory type!\n");
-                      return -1;
-                 }
-                 directory ->FetchFrom(dirFile);    //move to current directory
-             }
-        }
-        delete dirFile;
-        delete directory;
-
-        return sector;  
-    } else{                    // relative address
-        sector = directoryFile->FileSector();
-        dirFile = new OpenFile(sector);   //the current directory
-
-        directory = new Directory(NumDirEntries);
-        directory ->FetchFrom(dirFile);
-
-        tokenPtr = strtok(path, "/");
-        while(tokenPtr != NULL){
-             delete dirFile;
-             
-             sector = directory ->Find(tokenPtr);
-             if(sector == -1)
-                return -1;
-
-             tokenPtr = strtok(NULL, "/"); 
-             dirFile = new OpenFile(sector);
-             
-             if(tokenPtr != NULL){
-                 if(dirFile ->FileType() == TYPE_FILE)   //this is a file, not a directory
-                      return -1;
-
-                 directory ->FetchFrom(dirFile);
-             }
-        }
-        delete dirFile;
-        delete directory;
-
-        return sector; 
-    } 
+    else
+        sector = directoryFile->FileSector();   //the current directory
+    type = TYPE_DIR;
+
+    tokenPtr = strtok(path, "/");
+    while(tokenPtr != NULL){
+         if(type == TYPE_FILE){   //this is a file, not a directory
+             if(absolute)
+                 printf("Current file is a file type, not a directory type!\n");
+             return -1;
+         }
+         sector = LookupEntry(sector, tokenPtr, &type);   //find in the current directory
+         if(sector == -1){
+             if(absolute)
+                 printf("Failed to find the directory/file %s in current directory\n", tokenPtr);
+             return -1;
+         }
+         tokenPtr = strtok(NULL, "/"); 
+    }
+    return sector;
 }
 
 //----------------------------------------------------------------------
@@ -296,12 +683,14 @@ FileSystem::FindFile(const char *strpath)
 // 	Create fails if:
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
 //	 	no free space for data blocks for the file 
 //
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
 //
+//	The directory grows when it is full, so the only limit on the
+//	number of files is the space on disk.
+//
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
 //----------------------------------------------------------------------
@@ -310,57 +699,70 @@ bool
 FileSystem::Create(char *name, int initialSize, char *path)
 {
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *hdr;
     int sector;
     bool success;
     OpenFile *dirFile = NULL;
+    int dirSector = directoryFile->FileSector();
     
     DEBUG('f', "Creating file %s, size %d\n", name, initialSize);
 
     directory = new Directory(NumDirEntries);
+    journal->Begin();
     if(path == NULL)
         directory->FetchFrom(directoryFile);
     else{
-        sector = this -> FindFile(path);
-        if(sector == -1)
+        dirSector = this -> FindFile(path);
+        if(dirSector == -1) {
+            journal->End();
+            delete directory;
             return FALSE;
+        }
 
-        dirFile = new OpenFile(sector);
+        dirFile = new OpenFile(dirSector);
         directory ->FetchFrom(dirFile);
     }   
 
     if (directory->Find(name) != -1)
       success = FALSE;			// file is already in directory
     else {	
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
+        freeMapLock->Acquire();
         sector = freeMap->Find();	// find a sector to hold the file header
     	if (sector == -1) 		
             success = FALSE;		// no free block for file header 
-      else if (!directory->Add(name, sector))
+      else if (!RoomToAdd(directory, initialSize)
+                || !directory->Add(name, sector)) {
+            freeMap->Clear(sector);
             success = FALSE;	// no space in directory
+      }
 	else {
     	    hdr = new FileHeader;
-	    if (!hdr->Allocate(freeMap, initialSize))
+	    if (!hdr->Allocate(freeMap, initialSize)) {
+                freeMap->Clear(sector);
             	success = FALSE;	// no space on disk for data
-	    else {	
+	    } else {	
 	    	success = TRUE;
              hdr->Init(TYPE_FILE, -1);
 		// everthing worked, flush all changes back to disk
     	    	hdr->WriteBack(sector); 
-    	    	freeMap->WriteBack(freeMapFile);
-              if(path == NULL)
-                    directory ->WriteBack(directoryFile);        // flush to disk
-              else {
-                    directory ->WriteBack(dirFile);
-                    delete dirFile;
-              }
+    	    	FlushFreeMap();
 	    }
             delete hdr;
 	}
-        delete freeMap;
+        freeMapLock->Release();
+
+        // outside the lock: growing the directory file takes it again
+        if (success) {
+              if(path == NULL)
+                    directory ->WriteBack(directoryFile);        // flush to disk
+              else
+                    directory ->WriteBack(dirFile);
+              dentryCache->Enter(dirSector, name, sector, TYPE_FILE);
+        }
     }
+    journal->End();
+    if (dirFile != NULL)
+        delete dirFile;
     delete directory;
     return success;
 }
@@ -375,46 +777,60 @@ bool
 FileSystem::CreateDirectory(char *name, char *path)
 {
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *hdr;
     int sector;
     bool success;
-    OpenFile *dirFile;
+    OpenFile *dirFile = NULL;
+    int dirSector = directoryFile->FileSector();
 
     DEBUG('f', "Creating file %s, size %d\n", name, DirectoryFileSize);
 
     directory = new Directory(NumDirEntries);
+    journal->Begin();
     
      if(path == NULL)    
         directory->FetchFrom(directoryFile);
     else{
-        sector = FindFile(path);
-        if(sector == -1)
+        dirSector = FindFile(path);
+        if(dirSector == -1) {
+            journal->End();
+            delete directory;
             return FALSE;
+        }
 
-        dirFile = new OpenFile(sector);
+        dirFile = new OpenFile(dirSector);
         directory ->FetchFrom(dirFile);
     } 
 
     if (directory->Find(name) != -1)
       success = FALSE;			// file is already in directory
     else {	
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
+        freeMapLock->Acquire();
         sector = freeMap->Find();	// find a sector to hold the file header
     	  if (sector == -1) 		
              success = FALSE;		// no free block for file header 
-        else if (!directory->Add(name, sector))
+        else if (!RoomToAdd(directory, DirectoryFileSize)
+                  || !directory->Add(name, sector)) {
+             freeMap->Clear(sector);
              success = FALSE;	// no space in directory
+        }
 	  else {
     	      hdr = new FileHeader;
-	      if (!hdr->Allocate(freeMap, DirectoryFileSize))
+	      if (!hdr->Allocate(freeMap, DirectoryFileSize)) {
+                    freeMap->Clear(sector);
             	    success = FALSE;	// no space on disk for data
-	      else {	
+	      } else {	
 	    	    success = TRUE;
                   hdr ->Init(TYPE_DIR, directoryFile ->FileSector());   
                   hdr ->WriteBack(sector);
-                  
+    	    	      FlushFreeMap();
+               }
+               delete hdr;
+        }
+        freeMapLock->Release();
+
+        // outside the lock: growing the directory file takes it again
+        if (success) {
                   OpenFile  *newdirfile = new OpenFile(sector);
                   Directory *newdir = new Directory(NumDirEntries);
 
@@ -426,19 +842,17 @@ FileSystem::CreateDirectory(char *name, char *path)
 
                    delete newdirfile;
                    delete newdir;
-           
-    	    	      freeMap->WriteBack(freeMapFile);
+
                     if(path == NULL)
                         directory ->WriteBack(directoryFile);        // flush to disk
-                    else{
+                    else
                         directory ->WriteBack(dirFile);
-                        delete dirFile;
-                    }      
-               }
-               delete hdr;
+                    dentryCache->Enter(dirSector, name, sector, TYPE_DIR);
         }
-        delete freeMap;
         }
+    journal->End();
+    if (dirFile != NULL)
+        delete dirFile;
     delete directory;
     return success;
 }
@@ -449,6 +863,7 @@ FileSystem::CreateDirectory(char *name, char *path)
 // 	Open a file for reading and writing.  
 //	To open a file:
 //	  Find the location of the file's header, using the directory 
+//	  (or a path from it)
 //	  Bring the header into memory
 //
 //	"name" -- the text name of the file to be opened
@@ -457,16 +872,13 @@ FileSystem::CreateDirectory(char *name, char *path)
 OpenFile *
 FileSystem::Open(char *name)
 { 
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
     int sector;
 
     DEBUG('f', "Opening file %s\n", name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    sector = FindFile(name);			// through the dentry cache
     if (sector >= 0) 		
 	openFile = new OpenFile(sector);	// name was found in directory 
-    delete directory;
     return openFile;				// return NULL if not found
 }
 
@@ -489,54 +901,65 @@ FileSystem::Remove(char *name, char *path)
 { 
     printf("Thread %s is trying to remove file %s\n",currentThread->getName(),name);
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *fileHdr;
     int sector;
     OpenFile *dirFile = NULL;
+    int dirSector = directoryFile->FileSector();
     directory = new Directory(NumDirEntries);
+    journal->Begin();
     
     if(path == NULL)
         directory->FetchFrom(directoryFile);
     else{
-        sector = FindFile(path);
-        if(sector == -1)
+        dirSector = FindFile(path);
+        if(dirSector == -1) {
+            journal->End();
+            delete directory;
             return FALSE;
+        }
 
-        dirFile = new OpenFile(sector);
+        dirFile = new OpenFile(dirSector);
         directory->FetchFrom(dirFile);
     }
          
     sector = directory->Find(name);
     if (sector == -1) {
+       journal->End();
+       if (dirFile != NULL)
+           delete dirFile;
        delete directory;
        return FALSE;			 // file not found 
     }
     if (fileManager->NumThread(sector)>0){
+        journal->End();
+        if (dirFile != NULL)
+            delete dirFile;
         delete directory;
-        printf("This file is also viewed by other %d threads! Can't remove!\n", fileManager->NumThread(sector));
+        printf("This file is still open %d times! Can't remove!\n", fileManager->NumThread(sector));
         return FALSE;
     }
     fileHdr = new FileHeader;
     fileHdr->FetchFrom(sector);
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-
+    freeMapLock->Acquire();
     fileHdr->Deallocate(freeMap);  		// remove data blocks
     freeMap->Clear(sector);			// remove header block
     directory->Remove(name);
+    dentryCache->Enter(dirSector, name, -1, TYPE_FILE);   // gone, and
+    dentryCache->Forget(sector);	// nothing left under it
 
-    freeMap->WriteBack(freeMapFile);		// flush to disk
+    FlushFreeMap();				// flush to disk
+    freeMapLock->Release();
     
     if(path != NULL){
         directory ->WriteBack(dirFile);
         delete dirFile;
     }else
         directory->WriteBack(directoryFile);        // flush to disk
+    journal->End();
         
     delete fileHdr;
     delete directory;
-    delete freeMap;
     return TRUE;
 } 
 
@@ -570,14 +993,14 @@ FileSystem::RemoveDirectory(char *name, char *path)
 bool 
 FileSystem::ChangeFileSize(FileHeader *hdr, int newSize)  
 {
-     BitMap *freeMap;
-     freeMap = new BitMap(NumSectors);
-     freeMap ->FetchFrom(freeMapFile);
-
+     journal->Begin();		// with the header, if the caller has one
+     freeMapLock->Acquire();
      bool flag = hdr ->ChangeSize(freeMap, newSize);
 
-     freeMap ->WriteBack(freeMapFile);        // flush to disk
-     delete freeMap;
+     if (flag)
+         FlushFreeMap();        // flush to disk
+     freeMapLock->Release();
+     journal->End();
 
      return flag;
 }
@@ -612,7 +1035,6 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    BitMap *freeMap = new BitMap(NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
@@ -623,15 +1045,15 @@ FileSystem::Print()
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMap->FetchFrom(freeMapFile);
+    freeMapLock->Acquire();
     freeMap->Print();
+    freeMapLock->Release();
 
     directory->FetchFrom(directoryFile);
     directory->Print();
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 } 
 
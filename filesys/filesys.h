@@ -37,13 +37,20 @@
 
 #include "copyright.h"
 #include "openfile.h"
+#include "bitmap.h"
+
+class Lock;
+class DentryCache;
+class Journal;
+class List;
+class Directory;
 
 #ifdef FILESYS_STUB 		// Temporarily implement file system calls as 
 				// calls to UNIX, until the real file system
 				// implementation is available
 class FileSystem {
   public:
-    FileSystem(bool format) {}
+    FileSystem(bool format, bool lfs = FALSE) {}
 
     bool Create(char *name, int initialSize) { 
 	int fileDescriptor = OpenForWrite(name);
@@ -65,14 +72,32 @@ class FileSystem {
 };
 
 #else // FILESYS
+
+// The last SwapSectors sectors of the disk are kept out of the file
+// system and used as the swap area of the virtual memory system, one
+// page per sector.
+#define SwapSectors 		256
+#define SwapStartSector 	(NumSectors - SwapSectors)
+
+// The metadata journal takes the JournalSectors sectors before it.
+#define JournalSectors 		64
+#define JournalStartSector 	(SwapStartSector - JournalSectors)
+
+// Flags of the file system, chosen when formatting and kept in the
+// header of the journal.
+#define LogStructuredFlag 	1	// file data is written log-structured
+
 class FileSystem {
   public:
-    FileSystem(bool format);		// Initialize the file system.
+    FileSystem(bool format, bool lfs = FALSE);
+    					// Initialize the file system.
 					// Must be called *after* "synchDisk" 
 					// has been initialized.
     					// If "format", there is nothing on
 					// the disk, so initialize the directory
-    					// and the bitmap of free blocks.
+    					// and the bitmap of free blocks, with
+					// the chosen layout.
+    ~FileSystem();			// Sync must have been called
 
     bool Create(char *name, int initialSize, char *path=NULL);  	
 					// Create a file (UNIX creat)
@@ -93,11 +118,45 @@ class FileSystem {
     //by LMX
     bool ChangeFileSize(FileHeader *hdr, int newSize);    //Dynamically change the size of a file
     bool Copy(char * src, char * dst, int size);
+
+    bool WriteToLog(FileHeader *hdr, int headSector, int *sectors,
+    		int count, char *data);	// Write data sectors of a file
+					// at the log head, if we may
+    bool LogsData(FileHeader *hdr, int headSector);
+    					// May its data go to the log head
+    bool RewriteFile(FileHeader *hdr, int headSector, char *data,
+    		int numBytes);		// Write a file again, to new
+					// sectors, unlogged
+
+    void BeginOperation();		// Start a change that must reach
+    void EndOperation();		// the disk whole, end it
+    void Sync();			// Write all of the journal in place
+    bool Check();			// Does the bitmap match the files?
   private:
+   void FlushFreeMap();			// Write the changed part of the
+					// free map to disk
+   void ReleaseReplaced(bool all);	// Free what WriteToLog replaced
+   int LookupEntry(int dirSector, char *name, int *type);
+   					// Find "name" in a directory
+   bool RoomToAdd(Directory *directory, int size);
+   					// Room for a file, and the table?
+   int CheckFile(int sector, BitMap *used);
+   					// Check a file, or a directory tree
+
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+   BitMap* freeMap;			// The bit map, kept in memory
+   BitMap* diskFreeMap;			// What "freeMapFile" holds
+   Lock* freeMapLock;			// Protects "freeMap"
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   DentryCache* dentryCache;		// Recent lookups in directories
+   Journal* journal;			// Makes each operation atomic
+   bool logStructured;			// Data written at the log head?
+   int logHead;				// Where the next run of data goes
+   class List *replaced;		// Sectors WriteToLog replaced, by
+					// the journal group moving off them
+   BitMap *replacedMap;			// The same sectors, free on disk
 };
 
 #endif // FILESYS
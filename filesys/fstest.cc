@@ -20,6 +20,7 @@
 #include "thread.h"
 #include "disk.h"
 #include "stats.h"
+#include "directory.h"
 
 #define TransferSize 	10 	// make it small, just to be difficult
 
@@ -245,3 +246,207 @@ PerformanceTest()
     //TestMutiThread();
 }
 
+
+//----------------------------------------------------------------------
+// DirectoryTest
+// 	Stress test for the directories: create a lot of empty files in
+//	one directory, look each of them up (and as many names that are
+//	not there), then remove them all; a few rounds, so that the
+//	deleted entries get reused.  Prints the time and disk requests
+//	each step took, and the time per operation: with the hash table
+//	it should stay about the same as the directory grows.
+//
+//	Run with "files", or if that is 0, once with each of
+//	DirBenchSizes files.  Empty files only take a header sector, but
+//	the disk is small (NumSectors): about 500 of them fit next to the
+//	directory, so the sizes stop at 400.  Thousands of files need a
+//	disk with more tracks.
+//----------------------------------------------------------------------
+
+#define DirBenchRounds	3
+
+static int DirBenchSizes[] = { 50, 100, 200, 400 };
+
+static void
+DirBenchReport(char *step, int files, int ticks, int reads, int writes)
+{
+    int spent = stats->totalTicks - ticks;
+
+    printf("  %-8s %d ops, %d ticks (%d per op), %d disk reads, "
+        "%d disk writes\n", step, files, spent, spent / files,
+        stats->numDiskReads - reads, stats->numDiskWrites - writes);
+}
+
+static bool
+DirBenchRun(int files)
+{
+    char name[FileNameMaxLen + 1];
+    int i, round, ticks, reads, writes;
+
+    printf("Starting directory test: %d rounds of %d files\n",
+        DirBenchRounds, files);
+    for (round = 0; round < DirBenchRounds; round++) {
+        printf("Round %d:\n", round);
+
+        ticks = stats->totalTicks;
+        reads = stats->numDiskReads;
+        writes = stats->numDiskWrites;
+        for (i = 0; i < files; i++) {
+            sprintf(name, "d%d", i);
+            if (!fileSystem->Create(name, 0)) {
+                printf("Directory test: can't create %s\n", name);
+                return FALSE;
+            }
+        }
+        DirBenchReport("create", files, ticks, reads, writes);
+
+        ticks = stats->totalTicks;
+        reads = stats->numDiskReads;
+        writes = stats->numDiskWrites;
+        for (i = 0; i < files; i++) {
+            sprintf(name, "d%d", i);
+            if (fileSystem->FindFile(name) == -1) {
+                printf("Directory test: lost %s\n", name);
+                return FALSE;
+            }
+        }
+        DirBenchReport("lookup", files, ticks, reads, writes);
+
+        ticks = stats->totalTicks;
+        reads = stats->numDiskReads;
+        writes = stats->numDiskWrites;
+        for (i = 0; i < files; i++) {
+            sprintf(name, "x%d", i);
+            if (fileSystem->FindFile(name) != -1) {
+                printf("Directory test: found %s, never created\n", name);
+                return FALSE;
+            }
+        }
+        DirBenchReport("miss", files, ticks, reads, writes);
+
+        ticks = stats->totalTicks;
+        reads = stats->numDiskReads;
+        writes = stats->numDiskWrites;
+        for (i = 0; i < files; i++) {
+            sprintf(name, "d%d", i);
+            if (!fileSystem->Remove(name)) {
+                printf("Directory test: can't remove %s\n", name);
+                return FALSE;
+            }
+        }
+        DirBenchReport("remove", files, ticks, reads, writes);
+    }
+    return TRUE;
+}
+
+void
+DirectoryTest(int files)
+{
+    if (files > 0)
+        DirBenchRun(files);
+    else
+        for (unsigned int i = 0;
+                i < sizeof(DirBenchSizes) / sizeof(DirBenchSizes[0]); i++)
+            if (!DirBenchRun(DirBenchSizes[i]))
+                break;
+    printf("Directory test done\n");
+}
+
+//----------------------------------------------------------------------
+// RandomWriteTest
+// 	Small writes all over a file: "writes" of RandWriteSize bytes, each
+//	at a random place, into a file of RandFileSectors sectors kept
+//	open, as a database would.  Prints the time and disk requests they
+//	took, with and without -lfs, then checks the file against a copy
+//	kept in memory.
+//----------------------------------------------------------------------
+
+#define RandFileName	"RandFile"
+#define RandFileSectors	64
+#define RandWriteSize	64
+
+void
+RandomWriteTest(int writes)
+{
+    int size = RandFileSectors * SectorSize;
+    char *shadow = new char[size], *contents = new char[size];
+    char data[RandWriteSize];
+    OpenFile *openFile;
+    int i, position, ticks, reads, diskWrites;
+
+    printf("Random write test: %d writes of %d bytes into %d bytes\n",
+        writes, RandWriteSize, size);
+    if (!fileSystem->Create(RandFileName, size)
+            || (openFile = fileSystem->Open(RandFileName)) == NULL) {
+        printf("Random write test: can't create %s\n", RandFileName);
+        delete [] shadow;
+        delete [] contents;
+        return;
+    }
+    bzero(shadow, size);
+    openFile->WriteAt(shadow, size, 0);
+
+    ticks = stats->totalTicks;
+    reads = stats->numDiskReads;
+    diskWrites = stats->numDiskWrites;
+    for (i = 0; i < writes; i++) {
+        position = (Random() % (size / RandWriteSize)) * RandWriteSize;
+        memset(data, 'a' + i % 26, RandWriteSize);
+        bcopy(data, &shadow[position], RandWriteSize);
+        openFile->WriteAt(data, RandWriteSize, position);
+    }
+    delete openFile;			// what is left goes to disk
+    printf("  %d ticks, %d disk reads, %d disk writes\n",
+        stats->totalTicks - ticks, stats->numDiskReads - reads,
+        stats->numDiskWrites - diskWrites);
+
+    openFile = fileSystem->Open(RandFileName);
+    if (openFile->ReadAt(contents, size, 0) != size
+            || bcmp(contents, shadow, size) != 0)
+        printf("Random write test: the file doesn't hold what was written\n");
+    delete openFile;
+    if (!fileSystem->Remove(RandFileName))
+        printf("Random write test: unable to remove %s\n", RandFileName);
+    delete [] shadow;
+    delete [] contents;
+}
+
+//----------------------------------------------------------------------
+// CrashTest
+// 	Fault injection for the journal: create files in a directory and
+//	remove some of them, with the disk set to stop Nachos dead before
+//	its "writes"th write from now.  Run as "nachos -f -crash <n>",
+//	then "nachos -check": mounting the disk replays the journal, and
+//	every operation must be there completely or not at all -- the
+//	check finds each header, index and data sector reachable from
+//	the directories marked in the bitmap, and nothing else.
+//
+//	CrashFiles is enough for the directory to be rehashed a couple
+//	of times (see OpenFile::Rewrite).
+//----------------------------------------------------------------------
+
+#define CrashFiles	48
+
+void
+CrashTest(int writes)
+{
+    char name[FileNameMaxLen + 1];
+
+    printf("Crash test: crashing before disk write %d\n", writes);
+    synchDisk->CrashAfter(writes);
+    fileSystem->CreateDirectory("crash");
+    for (int i = 0; i < CrashFiles; i++) {
+        sprintf(name, "c%d", i);
+        if (!fileSystem->Create(name, 3 * SectorSize, "/crash")) {
+            printf("Crash test: can't create %s\n", name);
+            return;
+        }
+        if (i % 3 == 2) {
+            sprintf(name, "c%d", i - 1);
+            fileSystem->Remove(name, "/crash");
+        }
+    }
+    fileSystem->Sync();
+    synchDisk->CrashAfter(0);
+    printf("Crash test: done before disk write %d, no crash\n", writes);
+}
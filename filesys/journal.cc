@@ -0,0 +1,479 @@
+// journal.cc
+//	Routines to log the changes of the file system metadata, so that
+//	an operation is on disk either completely or not at all.
+//
+//	The synch disk hands every write to Journal::Intercept and every
+//	read to Journal::Lookup; a thread inside a transaction has its
+//	writes kept, other threads only when they write a sector the
+//	journal still holds (then it becomes a transaction of its own, so
+//	that it is not overwritten by the older version later).
+//
+//	A group is cut short where the next transaction would not fit in
+//	the log with it (see End).  A transaction has to fit alone: the
+//	file system keeps them to a few headers, index sectors, bitmap
+//	sectors and directory entries; a directory table rewritten whole
+//	goes to new sectors, not through the log (see WriteFresh).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "synch.h"
+#include "system.h"
+
+#define HeaderMagic 		0x4a524e4c	// "JRNL"
+#define DescriptorMagic 	0x44455343	// "DESC"
+#define CommitMagic 		0x434f4d54	// "COMT"
+
+#define IntsPerSector 		((int) (SectorSize / sizeof(int)))
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal of a log of "size" sectors from "start".
+//	Format or Recover must be called before the file system is used.
+//----------------------------------------------------------------------
+
+Journal::Journal(int start, int size)
+{
+    startSector = start;
+    numSectors = size;
+    nextFree = startSector + 1;
+    seq = 1;
+    flags = 0;
+    lock = new Lock("journal");
+    depth = 0;
+    flushing = FALSE;
+    open = committed = logged = NULL;
+    numOpen = numCommitted = numLogged = 0;
+    commitCount = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  Sync must have written everything it
+//	held in place.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    ASSERT(open == NULL && committed == NULL && logged == NULL);
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Put
+// 	Record that "sector" now holds "data", in one of the lists of
+//	changes; replace what the list had for the sector.
+//----------------------------------------------------------------------
+
+void
+Journal::Put(JournalImage **list, int *count, int sector, char *data)
+{
+    JournalImage *image = Find(*list, sector);
+
+    if (image == NULL) {
+        image = new JournalImage;
+        image->sector = sector;
+        image->next = *list;
+        *list = image;
+        (*count)++;
+    }
+    bcopy(data, image->data, SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Journal::Merge
+// 	Move the changes of list "from" into list "to", where they
+//	replace older changes of the same sectors.
+//----------------------------------------------------------------------
+
+void
+Journal::Merge(JournalImage **from, JournalImage **to, int *count)
+{
+    while (*from != NULL) {
+        JournalImage *image = *from;
+        *from = image->next;
+        Put(to, count, image->sector, image->data);
+        delete image;
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::LogSectors
+// 	Return how many sectors of the log a group changing "images"
+//	sectors takes: descriptor blocks, the sectors, the commit block.
+//	The header leaves numSectors - 1 for the groups.
+//----------------------------------------------------------------------
+
+int
+Journal::LogSectors(int images)
+{
+    return divRoundUp(images, ImagesPerBlock) + images + 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Write the header of an empty log, whose first group will have
+//	sequence number "seq".  Groups left from before don't match it.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteHeader()
+{
+    int block[IntsPerSector];
+
+    bzero((char *) block, SectorSize);
+    block[0] = HeaderMagic;
+    block[1] = seq;
+    block[2] = flags;
+    synchDisk->WriteSector(startSector, (char *) block);
+    nextFree = startSector + 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Write an empty log, on a disk being formatted.  "fsFlags" is
+//	stored with it, for Flags to return on later runs.
+//----------------------------------------------------------------------
+
+void
+Journal::Format(int fsFlags)
+{
+    seq = 1;
+    flags = fsFlags;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Redo the groups of transactions found in the log: a group counts
+//	only if its commit block made it to disk.  Then empty the log.
+//	Called when the file system is mounted, before anything else
+//	reads it.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    int block[IntsPerSector];
+    char data[SectorSize];
+    int end = startSector + numSectors;
+    int pos = startSector + 1;
+    int groups = 0;
+
+    synchDisk->ReadSector(startSector, (char *) block);
+    if (block[0] != HeaderMagic) {	// no journal on this disk yet
+        Format(0);
+        return;
+    }
+    seq = block[1];
+    flags = block[2];
+
+    for (;;) {
+        int first = pos;
+        bool complete = FALSE;
+
+    // Find the commit block of the group
+        while (pos < end) {
+            synchDisk->ReadSector(pos, (char *) block);
+            if (block[1] != seq)
+                break;
+            if (block[0] == CommitMagic) {
+                complete = TRUE;
+                pos++;
+                break;
+            }
+            if (block[0] != DescriptorMagic || block[2] < 0
+                    || block[2] > ImagesPerBlock || pos + 1 + block[2] > end)
+                break;
+            pos += 1 + block[2];
+        }
+        if (!complete)
+            break;
+
+    // It is all there: write its sectors in place
+        for (int p = first; p < pos - 1; p += 1 + block[2]) {
+            synchDisk->ReadSector(p, (char *) block);
+            for (int i = 0; i < block[2]; i++) {
+                synchDisk->ReadSector(p + 1 + i, data);
+                synchDisk->WriteSector(block[3 + i], data);
+            }
+        }
+        DEBUG('f', "Journal: redid group %d\n", seq);
+        seq++;
+        groups++;
+    }
+    if (groups > 0)
+        printf("Journal: recovered %d committed groups\n", groups);
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start a transaction.  One thread at a time runs transactions;
+//	a transaction started inside another one is part of it.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    if (lock->isHeldByCurrentThread()) {
+        depth++;
+        return;
+    }
+    lock->Acquire();
+    depth = 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Commit the transaction.  Once GroupCommitSize transactions are
+//	committed, log them together; sooner if the group would not fit
+//	in the log with this one.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    ASSERT(lock->isHeldByCurrentThread() && depth > 0);
+    if (--depth > 0)
+        return;
+
+    if (open != NULL) {
+        ASSERT(LogSectors(numOpen) <= numSectors - 1);	// fits alone
+        if (LogSectors(numCommitted + numOpen) > numSectors - 1)
+            Flush();			// log the group without it
+        Merge(&open, &committed, &numCommitted);
+        numOpen = 0;
+        commitCount++;
+    }
+    if (commitCount >= GroupCommitSize)
+        Flush();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Intercept
+// 	A thread writes "data" to "sector".  Keep it if the thread is
+//	inside a transaction, or if it writes a sector we hold (a data
+//	sector that held metadata before, or a header being updated):
+//	that write has to reach the disk after the older version.
+//	Return TRUE if we kept it, FALSE if it goes to the disk.
+//----------------------------------------------------------------------
+
+bool
+Journal::Intercept(int sector, char *data)
+{
+    if (sector >= startSector)
+        return FALSE;			// the log itself, or swap space
+    if (lock->isHeldByCurrentThread()) {
+        if (flushing || depth == 0)
+            return FALSE;		// the log itself, or a checkpoint
+        Put(&open, &numOpen, sector, data);
+        return TRUE;
+    }
+    if (Find(open, sector) == NULL && Find(committed, sector) == NULL
+            && Find(logged, sector) == NULL)
+        return FALSE;
+
+    Begin();
+    Put(&open, &numOpen, sector, data);
+    End();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Lookup
+// 	If the journal holds changes to "sector", copy the newest into
+//	"data" and return TRUE.  Only the thread running the transaction
+//	sees its changes; the others read what is committed.
+//
+//	We don't take the lock: a reader would wait for every transaction,
+//	and one holding a file's read lock for a transaction that waits on
+//	the file's write lock.  None is needed, as the lists only change
+//	without blocking, and Nachos only switches threads where they
+//	block or enable interrupts, so we never see one half changed.
+//----------------------------------------------------------------------
+
+bool
+Journal::Lookup(int sector, char *data)
+{
+    JournalImage *lists[3] = { open, committed, logged };
+    JournalImage *image;
+
+    if (sector >= startSector)
+        return FALSE;			// not file system: swap space
+    for (int i = lock->isHeldByCurrentThread() ? 0 : 1; i < 3; i++)
+        if ((image = Find(lists[i], sector)) != NULL) {
+            bcopy(image->data, data, SectorSize);
+            return TRUE;
+        }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Find
+// 	Return the change of "list" to "sector", or NULL.
+//----------------------------------------------------------------------
+
+JournalImage *
+Journal::Find(JournalImage *list, int sector)
+{
+    for (; list != NULL; list = list->next)
+        if (list->sector == sector)
+            return list;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Journal::Flush
+// 	Append the changes of the committed transactions to the log, as
+//	one group: descriptor blocks with the sectors they go to, followed
+//	by the sectors, then the commit block.  All sequential, so it
+//	costs about one seek.  Checkpoint first if the log is full.
+//----------------------------------------------------------------------
+
+void
+Journal::Flush()
+{
+    int block[IntsPerSector];
+    int end = startSector + numSectors;
+    bool wasFlushing = flushing;
+
+    if (numCommitted == 0)
+        return;
+
+    int needed = LogSectors(numCommitted);
+    if (nextFree + needed > end)
+        Checkpoint();
+    ASSERT(nextFree + needed <= end);	// End keeps groups that small
+
+    flushing = TRUE;
+
+    DEBUG('f', "Journal: logging group %d, %d transactions, %d sectors\n",
+          seq, commitCount, numCommitted);
+    JournalImage *image = committed;
+    while (image != NULL) {
+        JournalImage *first = image;
+        int n = 0;
+
+        bzero((char *) block, SectorSize);
+        block[0] = DescriptorMagic;
+        block[1] = seq;
+        for (; image != NULL && n < ImagesPerBlock; image = image->next)
+            block[3 + n++] = image->sector;
+        block[2] = n;
+        synchDisk->WriteSector(nextFree++, (char *) block);
+        for (JournalImage *i = first; i != image; i = i->next)
+            synchDisk->WriteSector(nextFree++, i->data);
+    }
+    bzero((char *) block, SectorSize);
+    block[0] = CommitMagic;
+    block[1] = seq;
+    synchDisk->WriteSector(nextFree++, (char *) block);	// it counts now
+    seq++;
+
+    Merge(&committed, &logged, &numLogged);
+    numCommitted = 0;
+    commitCount = 0;
+    flushing = wasFlushing;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteDirect
+// 	Write the changes of a list in place, and empty it.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteDirect(JournalImage **list, int *count)
+{
+    while (*list != NULL) {
+        JournalImage *image = *list;
+        synchDisk->WriteSector(image->sector, image->data);
+        *list = image->next;	// only now: it is on disk
+        delete image;
+    }
+    *count = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Write the logged changes in place, then empty the log.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    bool wasFlushing = flushing;
+
+    flushing = TRUE;
+    DEBUG('f', "Journal: checkpoint of %d sectors\n", numLogged);
+    WriteDirect(&logged, &numLogged);
+    WriteHeader();
+    flushing = wasFlushing;
+}
+
+//----------------------------------------------------------------------
+// Journal::Settle
+// 	Log what is committed, and write everything logged in place, from
+//	inside a transaction, which stays open.  Then the journal holds
+//	only the changes of that transaction, and a sector free in the
+//	bitmap is not in use on disk: see WriteFresh.
+//
+//	Settle moves NextGroup on: call it before asking for that.
+//----------------------------------------------------------------------
+
+void
+Journal::Settle()
+{
+    ASSERT(lock->isHeldByCurrentThread() && depth > 0);
+    Flush();
+    Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteFresh
+// 	Write "data" to "sector" straight to the disk, from inside a
+//	transaction, without logging it: the sector is free, and in no
+//	file until the transaction is committed, so a crash before that
+//	finds it unused.  Settle must have been called first, and the
+//	transaction must not have freed anything: else the sector could
+//	still be in use on disk, or hold metadata a checkpoint would
+//	write over ours.  A sector the transaction itself wrote stays in
+//	it.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteFresh(int sector, char *data)
+{
+    bool wasFlushing = flushing;
+
+    ASSERT(lock->isHeldByCurrentThread() && depth > 0);
+    ASSERT(committed == NULL && logged == NULL);
+    if (Find(open, sector) != NULL) {
+        Put(&open, &numOpen, sector, data);
+        return;
+    }
+    flushing = TRUE;
+    synchDisk->WriteSector(sector, data);
+    flushing = wasFlushing;
+}
+
+//----------------------------------------------------------------------
+// Journal::Sync
+// 	Log what is committed, and write everything in place: after this
+//	the disk is complete without the journal.  Called when Nachos
+//	is done with the file system.
+//----------------------------------------------------------------------
+
+void
+Journal::Sync()
+{
+    ASSERT(!lock->isHeldByCurrentThread());	// not in a transaction
+    lock->Acquire();
+    Flush();
+    Checkpoint();
+    lock->Release();
+}
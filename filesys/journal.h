@@ -0,0 +1,111 @@
+// journal.h
+//	Data structures for the metadata journal of the file system.
+//
+//	An operation that changes the file system (Create, Remove, growing
+//	a file...) is a transaction: between Begin and End, the sectors it
+//	writes through the synch disk are not written in place, but kept
+//	in memory.  At End the transaction is committed; once a few are
+//	(group commit), all the sectors they changed are appended to a
+//	log region of the disk, in one sequential run closed by a commit
+//	block.  Only then may they be written in place, which we put off
+//	until the log is full (checkpoint): a sector changed by several
+//	operations, like the free map, is written once.
+//
+//	Until its checkpoint, a sector is read from the journal, not from
+//	the disk.  When the file system is mounted, the groups found
+//	complete in the log are written in place again; an operation
+//	interrupted by a crash leaves no trace, or all of its changes.
+//
+//	The log holds:
+//	   a header: the sequence number of its first group, and the
+//	      flags the file system was formatted with
+//	   for each group, descriptor blocks each listing where the
+//	      ImagesPerBlock sectors that follow it belong, then a
+//	      commit block with the sequence number of the group
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "copyright.h"
+#include "disk.h"
+
+class Lock;
+
+#define GroupCommitSize 	4	// transactions logged together
+#define ImagesPerBlock 		((int) (SectorSize / sizeof(int)) - 3)
+
+// A sector changed by a transaction, not yet written in place.
+
+class JournalImage {
+  public:
+    int sector;				// Where it goes
+    char data[SectorSize];		// Its new contents
+    JournalImage *next;
+};
+
+class Journal {
+  public:
+    Journal(int start, int size);	// The log is "size" sectors,
+					// from sector "start"
+    ~Journal();
+
+    void Format(int fsFlags);		// Write an empty log
+    int Flags() { return flags; }	// What Format was given
+    void Recover();			// Redo the complete groups of
+					// the log, then empty it
+
+    void Begin();			// Start a transaction; they nest
+    void End();				// Commit it
+
+    bool Intercept(int sector, char *data);
+    					// Called on every disk write: keep
+					// the sector if it belongs to a
+					// transaction, return TRUE if so
+    bool Lookup(int sector, char *data);
+    					// Called on every disk read: return
+					// the newest contents the journal
+					// has for "sector", if any (the
+					// open transaction's only to it)
+    void Settle();			// Log and write in place everything
+					// but the open transaction
+    void WriteFresh(int sector, char *data);
+    					// Write a sector in no file yet,
+					// unlogged; after Settle
+    void Sync();			// Log and write in place everything
+    int NextGroup() { return seq; }	// The group what is committed now
+					// will be logged in
+
+  private:
+    int startSector;			// Header sector of the log
+    int numSectors;			// Size of the log, header included
+    int nextFree;			// Where the next group goes
+    int seq;				// Sequence number of the next group
+    int flags;				// Kept for the file system
+
+    Lock *lock;				// Held through a transaction
+    int depth;				// Nesting of Begin
+    bool flushing;			// Writing the log or checkpointing:
+					// our writes go to the disk
+
+    JournalImage *open;			// Changes of the open transaction
+    JournalImage *committed;		// Changes committed, not yet logged
+    JournalImage *logged;		// Changes logged, not yet in place
+    int numOpen, numCommitted, numLogged;	// Sectors in these lists
+    int commitCount;			// Transactions in "committed"
+
+    JournalImage *Find(JournalImage *list, int sector);
+    void Put(JournalImage **list, int *count, int sector, char *data);
+    void Merge(JournalImage **from, JournalImage **to, int *count);
+    int LogSectors(int images);		// Log space a group of them takes
+    void Flush();			// Log the committed transactions
+    void Checkpoint();			// Write the logged sectors in
+					// place, and empty the log
+    void WriteDirect(JournalImage **list, int *count);
+    void WriteHeader();
+};
+
+#endif // JOURNAL_H
@@ -24,13 +24,23 @@
 // 	Open a Nachos file for reading and writing.  Bring the file header
 //	into memory while the file is open.
 //
+//	We are counted before we read the header, and read it under the
+//	file's read lock, so the file's sectors can't move under us
+//	(cf. FileSystem::WriteToLog).
+//
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 { 
+    fileManager->Append(sector);	// for the file's reader/writer lock
     hdr = new FileHeader;
+    fileManager->LockReadFile(sector);
     hdr->FetchFrom(sector);
+    fileManager->ReleaseReadFile(sector);
+    indexCache = new IndexCache;
+    appendBuffer = NULL;
+    appendBytes = 0;
     seekPosition = 0;
     headSector = sector;
 }
@@ -38,11 +48,34 @@ OpenFile::OpenFile(int sector)
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	Bytes still in the append buffer are written first, then the
+//	sectors kept in the file's segment.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
+    FlushAppends();
+    fileManager->LockWriteFile(headSector);
+    FlushSegment();
+    fileManager->ReleaseWriteFile(headSector);
+    fileManager->Remove(headSector);
+    if (appendBuffer != NULL)
+        delete [] appendBuffer;
     delete hdr;
+    delete indexCache;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Refresh
+// 	Bring the file header into memory again: another OpenFile on the
+//	same file may have changed its size and sectors since we read it.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Refresh()
+{
+    hdr->FetchFrom(headSector);
+    indexCache->Invalidate();
 }
 
 //----------------------------------------------------------------------
@@ -75,25 +108,45 @@ OpenFile::Seek(int position)
 int
 OpenFile::Read(char *into, int numBytes)
 {
-   hdr->setAccessTime(stats->totalTicks);
    //int result = ReadAt(into, numBytes, seekPosition, TRUE);
    int result = ReadAt(into, numBytes, seekPosition);
    seekPosition += result;
-   hdr->WriteBack(headSector);
+   Stamp(FALSE);
    return result;
 }
 
 int
 OpenFile::Write(char *into, int numBytes)
 {
-   hdr->setModifyTime(stats->totalTicks);
    //int result = WriteAt(into, numBytes, seekPosition, TRUE);
    int result = WriteAt(into, numBytes, seekPosition);
    seekPosition += result;
-   hdr->WriteBack(headSector);
+   Stamp(TRUE);
    return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::Stamp
+// 	Record in the header that the file was just read, or written if
+//	"modified".  Another OpenFile may have changed the header since
+//	we read it (grown the file, moved its sectors), so we read it
+//	again under the write lock and change only the time: writing
+//	back our copy would undo what it did.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Stamp(bool modified)
+{
+    fileManager->LockWriteFile(headSector);
+    Refresh();
+    if (modified)
+        hdr->setModifyTime(stats->totalTicks);
+    else
+        hdr->setAccessTime(stats->totalTicks);
+    hdr->WriteBack(headSector);
+    fileManager->ReleaseWriteFile(headSector);
+}
+
 //----------------------------------------------------------------------
 // OpenFile::ReadAt/WriteAt
 // 	Read/write a portion of a file, starting at "position".
@@ -113,6 +166,17 @@ OpenFile::Write(char *into, int numBytes)
 //	   in the data that will be modified, and write back all the full
 //	   or partial sectors that are part of the request.
 //
+//	   Except when the write appends to a regular file: then the bytes
+//	   are only copied to the append buffer.  They get their sectors,
+//	   all in one allocation and next to each other, when the buffer
+//	   fills, the file is read or written elsewhere, or it is closed.
+//	   Until then, other OpenFiles on the file don't see them.  This
+//	   pays off for a writer that keeps the file open, like Copy; the
+//	   system calls close it after every Write (see SysWrite).
+//
+//	Reads hold the file's read lock and writes its write lock, from
+//	the file manager, while they use the disk.
+//
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
 //	"numBytes" -- the number of bytes to transfer
@@ -122,6 +186,109 @@ OpenFile::Write(char *into, int numBytes)
 
 int
 OpenFile::ReadAt(char *into, int numBytes, int position, bool ifCache)
+{
+    int result;
+
+    FlushAppends();			// before we look at the length
+
+    fileManager->LockReadFile(headSector);
+    result = ReadThrough(into, numBytes, position, ifCache);
+    fileManager->ReleaseReadFile(headSector);
+    return result;
+}
+
+int
+OpenFile::WriteAt(char *from, int numBytes, int position, bool ifCache)
+{
+    int result;
+
+    if (numBytes > 0 && !ifCache && hdr->getType() == TYPE_FILE
+            && position == hdr->FileLength() + appendBytes
+            && numBytes <= AppendBufferSize) {	// an append: keep it
+        if (appendBytes + numBytes > AppendBufferSize)
+            FlushAppends();		// make room
+        if (appendBuffer == NULL)
+            appendBuffer = new char[AppendBufferSize];
+        bcopy(from, &appendBuffer[appendBytes], numBytes);
+        appendBytes += numBytes;
+        return numBytes;
+    }
+    FlushAppends();			// the write may overlap them
+
+    fileManager->LockWriteFile(headSector);
+    result = WriteThrough(from, numBytes, position, ifCache);
+    fileManager->ReleaseWriteFile(headSector);
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FlushAppends
+// 	Write the bytes in the append buffer at the end of the file.  The
+//	file grows once for all of them, so its new sectors are allocated
+//	together, in a run if the disk has one.
+//
+//	Another OpenFile may have grown the file since we read its header,
+//	so we read it again, under the write lock, before taking its end.
+//----------------------------------------------------------------------
+
+void
+OpenFile::FlushAppends()
+{
+    int bytes = appendBytes;
+    int result;
+
+    if (bytes == 0)
+        return;
+    appendBytes = 0;
+    DEBUG('f', "Flushing %d appended bytes of file %d\n", bytes, headSector);
+    fileManager->LockWriteFile(headSector);
+    Refresh();
+    result = WriteThrough(appendBuffer, bytes, hdr->FileLength(), FALSE);
+    fileManager->ReleaseWriteFile(headSector);
+    if (result != bytes)
+        printf("No space to append %d bytes to file %d\n", bytes, headSector);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Rewrite
+// 	Write "numBytes" from "from" at the start of the file, like
+//	WriteAt, but to new sectors, switched to in the caller's
+//	transaction (see FileSystem::RewriteFile); the data doesn't go
+//	through the journal.  For a directory table that was rehashed,
+//	which the log might not hold.  Create made sure there is room.
+//----------------------------------------------------------------------
+
+int
+OpenFile::Rewrite(char *from, int numBytes)
+{
+    int numSectors = divRoundUp(numBytes, SectorSize);
+    char *buf = new char[numSectors * SectorSize];
+    bool done;
+
+    fileManager->LockWriteFile(headSector);
+    Refresh();
+    ASSERT(!hdr->IsInline());
+    if (numBytes % SectorSize != 0 && numBytes < hdr->FileLength())
+        ReadThrough(&buf[(numSectors - 1) * SectorSize], SectorSize,
+                    (numSectors - 1) * SectorSize, FALSE);	// the rest
+    bcopy(from, buf, numBytes);
+    done = fileSystem->RewriteFile(hdr, headSector, buf, numBytes);
+    ASSERT(done);
+    indexCache->Invalidate();
+    delete [] buf;
+    fileManager->ReleaseWriteFile(headSector);
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadThrough/WriteThrough
+// 	Read/write a portion of the file, as described for ReadAt and
+//	WriteAt above.  The caller holds the file's lock; WriteThrough
+//	reads partial sectors with ReadThrough, under its write lock.
+//----------------------------------------------------------------------
+
+int
+OpenFile::ReadThrough(char *into, int numBytes, int position, bool ifCache)
 {
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
@@ -133,6 +300,11 @@ OpenFile::ReadAt(char *into, int numBytes, int position, bool ifCache)
     DEBUG('f', "Reading %d bytes at %d, from file of length %d.\n", 	
 			numBytes, position, fileLength);
 
+    if (hdr->IsInline()) {      // the data is in the header, no disk access
+        bcopy(hdr->InlineData() + position, into, numBytes);
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
@@ -140,17 +312,15 @@ OpenFile::ReadAt(char *into, int numBytes, int position, bool ifCache)
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
 
-    //Access synchDisk, need lock!
-    //fileManager->LockReadFile(headSector);
     for (i = firstSector; i <= lastSector; i++){
-        if(ifCache==FALSE)
-            synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
+        if(ifCache==FALSE) {
+            if (!ReadSegment(i, &buf[(i - firstSector) * SectorSize]))
+                synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize, indexCache), 
 					&buf[(i - firstSector) * SectorSize]);
-	else
-            fileCache->CacheReadSector(hdr->ByteToSector(i * SectorSize), 
+        } else
+            fileCache->CacheReadSector(hdr->ByteToSector(i * SectorSize, indexCache), 
 					&buf[(i - firstSector) * SectorSize]);
     }
-    //fileManager->ReleaseReadFile(headSector);
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
@@ -158,7 +328,7 @@ OpenFile::ReadAt(char *into, int numBytes, int position, bool ifCache)
 }
 
 int
-OpenFile::WriteAt(char *from, int numBytes, int position, bool ifCache)
+OpenFile::WriteThrough(char *from, int numBytes, int position, bool ifCache)
 {
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
@@ -173,16 +343,28 @@ OpenFile::WriteAt(char *from, int numBytes, int position, bool ifCache)
          //if the bytes going to write will exceed the limit of the file size
          //first, allocate new disk sector
          printf("The file size needs to be increased! Size of file now: %d \n", hdr->FileLength());
+         fileSystem->BeginOperation();   // the sectors and the header together
          bool flag = fileSystem ->ChangeFileSize(hdr, position + numBytes);
-         if(flag == FALSE) 
+         if(flag == FALSE) {
+            fileSystem->EndOperation();
             return 0;
+         }
+         indexCache->Invalidate();      // the last index sector got new entries
          
          printf("Size of file now: %d \n", hdr->FileLength());
-         
+         if (!hdr->IsInline())
+             hdr->WriteBack(headSector);     // new size and new sectors
+         fileSystem->EndOperation();
     }
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n", 	
 			numBytes, position, fileLength);
 
+    if (hdr->IsInline()) {      // the data is in the header: write that
+        bcopy(from, hdr->InlineData() + position, numBytes);
+        hdr->WriteBack(headSector);
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
@@ -194,30 +376,107 @@ OpenFile::WriteAt(char *from, int numBytes, int position, bool ifCache)
 
 // read in first and last sector, if they are to be partially modified
     if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
+        ReadThrough(buf, SectorSize, firstSector * SectorSize, FALSE);
     if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
+        ReadThrough(&buf[(lastSector - firstSector) * SectorSize], 
+				SectorSize, lastSector * SectorSize, FALSE);
 
 // copy in the bytes we want to change 
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
-// write modified sectors back
-    //Access synchDisk, need lock!
-    //fileManager->LockWriteFile(headSector);
+// write modified sectors back; in the log-structured layout they
+// wait in the file's segment, to go to the log head together
     for (i = firstSector; i <= lastSector; i++){	
-        if(ifCache==FALSE)
-            synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
+        if (ifCache == FALSE && fileSystem->LogsData(hdr, headSector))
+            WriteSegment(i, &buf[(i - firstSector) * SectorSize]);
+        else if(ifCache==FALSE)
+            synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize, indexCache), 
 					&buf[(i - firstSector) * SectorSize]);
         else
-	    fileCache->CacheWriteSector(hdr->ByteToSector(i * SectorSize), 
+	    fileCache->CacheWriteSector(hdr->ByteToSector(i * SectorSize, indexCache), 
 					&buf[(i - firstSector) * SectorSize]);
     }
-    //fileManager->ReleaseWriteFile(headSector);
     delete [] buf;
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::ReadSegment/WriteSegment
+// 	Look for data sector "sector" of the file in its segment, where
+//	the sectors written lately wait to go to the log head, and copy
+//	it to "into" if it is there (cf. FileSystem::WriteToLog); or put
+//	it there, over any older copy.  A full segment is written out.
+//
+//	The segment is the file's, shared by all the OpenFiles on it;
+//	the caller holds the file's lock, the write lock to change it.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::ReadSegment(int sector, char *into)
+{
+    LogSegment *segment = fileManager->GetSegment(headSector, FALSE);
+
+    if (segment == NULL)
+        return FALSE;
+    for (int i = 0; i < segment->count; i++)
+        if (segment->sectors[i] == sector) {
+            bcopy(&segment->data[i * SectorSize], into, SectorSize);
+            return TRUE;
+        }
+    return FALSE;
+}
+
+void
+OpenFile::WriteSegment(int sector, char *from)
+{
+    LogSegment *segment = fileManager->GetSegment(headSector, TRUE);
+    int i;
+
+    for (i = 0; i < segment->count; i++)
+        if (segment->sectors[i] == sector)
+            break;
+    if (i == segment->count) {
+        segment->sectors[i] = sector;
+        segment->count++;
+    }
+    bcopy(from, &segment->data[i * SectorSize], SectorSize);
+    if (segment->count == SegmentSectors)
+        FlushSegment();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FlushSegment
+// 	Write out the sectors waiting in the file's segment: at the log
+//	head, in one run, if WriteToLog may move them; else in place.
+//	Until then they are not on disk, like the bytes in the append
+//	buffer; closing the file writes them.  The caller holds the
+//	file's write lock.
+//
+//	Another OpenFile may have put sectors in the segment that our
+//	header doesn't have yet, so we read it again first.  The header
+//	goes back to disk only if WriteToLog moved the sectors.
+//----------------------------------------------------------------------
+
+void
+OpenFile::FlushSegment()
+{
+    LogSegment *segment = fileManager->GetSegment(headSector, FALSE);
+
+    if (segment == NULL || segment->count == 0)
+        return;
+    DEBUG('f', "Flushing %d sectors of file %d\n", segment->count,
+          headSector);
+    Refresh();
+    if (!fileSystem->WriteToLog(hdr, headSector, segment->sectors,
+                                segment->count, segment->data))
+        for (int i = 0; i < segment->count; i++)
+            synchDisk->WriteSector(hdr->ByteToSector(
+                                segment->sectors[i] * SectorSize, indexCache),
+                                &segment->data[i * SectorSize]);
+    indexCache->Invalidate();		// WriteToLog changed the index sectors
+    segment->count = 0;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -226,7 +485,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position, bool ifCache)
 int
 OpenFile::Length() 
 { 
-    return hdr->FileLength(); 
+    return hdr->FileLength() + appendBytes; 
 }
 
 int 
@@ -60,6 +60,10 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class IndexCache;
+
+#define AppendBufferSize	(8 * SectorSize)	// appended bytes kept
+							// before allocating
 
 class OpenFile {
   public:
@@ -85,14 +89,34 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+    void FlushAppends();		// Allocate sectors for the bytes
+					// appended so far, and write them
+    int Rewrite(char *from, int numBytes);
+    					// Write the file from the start,
+					// to new sectors, in a transaction
     //by LMX
     int FileSector(){return headSector;}
     int FileType();
     int FilePath();
     int GetFileDescriptor(){return headSector;}
+    void Refresh();			// Re-read the header, after the file
+					// was changed through another OpenFile
     
   private:
+    int ReadThrough(char *into, int numBytes, int position, bool ifCache);
+    int WriteThrough(char *from, int numBytes, int position, bool ifCache);
+    					// ReadAt/WriteAt, without the append
+					// buffer and the file's lock
+    void Stamp(bool modified);		// Set the access or modify time
+    bool ReadSegment(int sector, char *into);
+    void WriteSegment(int sector, char *from);
+    void FlushSegment();		// Data sectors kept for the log head,
+					// under the file's write lock
+
     FileHeader *hdr;			// Header for this file 
+    IndexCache *indexCache;		// Its index sectors read last
+    char *appendBuffer;			// Bytes written past the end of
+    int appendBytes;			// the file, no sectors for them yet
     int seekPosition;			// Current position within the file
     int headSector;
 };
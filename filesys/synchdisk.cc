@@ -16,6 +16,7 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "journal.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -45,6 +46,8 @@ SynchDisk::SynchDisk(char* name)
     semaphore = new Semaphore("synch disk", 0);
     lock = new Lock("synch disk lock");
     disk = new Disk(name, DiskRequestDone, (int) this);
+    journal = NULL;
+    crashCountdown = 0;
 }
 
 //----------------------------------------------------------------------
@@ -64,6 +67,7 @@ SynchDisk::~SynchDisk()
 // SynchDisk::ReadSector
 // 	Read the contents of a disk sector into a buffer.  Return only
 //	after the data has been read.
+//	A sector the journal holds is read from there, without I/O.
 //
 //	"sectorNumber" -- the disk sector to read
 //	"data" -- the buffer to hold the contents of the disk sector
@@ -72,6 +76,8 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
+    if (journal != NULL && journal->Lookup(sectorNumber, data))
+        return;				// newer than what the disk has
     lock->Acquire();			// only one disk I/O at a time
     disk->ReadRequest(sectorNumber, data);
     semaphore->P();			// wait for interrupt
@@ -82,6 +88,7 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 // SynchDisk::WriteSector
 // 	Write the contents of a buffer into a disk sector.  Return only
 //	after the data has been written.
+//	The journal may keep the sector instead, to write it later.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -90,6 +97,12 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
+    if (journal != NULL && journal->Intercept(sectorNumber, data))
+        return;				// part of a transaction
+    if (crashCountdown > 0 && --crashCountdown == 0) {
+        printf("Crashing before writing sector %d\n", sectorNumber);
+        Exit(1);			// the disk stays as it is
+    }
     lock->Acquire();			// only one disk I/O at a time
     disk->WriteRequest(sectorNumber, data);
     semaphore->P();			// wait for interrupt
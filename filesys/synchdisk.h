@@ -14,6 +14,8 @@
 #include "disk.h"
 #include "synch.h"
 
+class Journal;
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -42,12 +44,22 @@ class SynchDisk {
 					// handler, to signal that the
 					// current disk operation is complete.
 
+    void SetJournal(Journal *j) { journal = j; }
+    					// Pass reads and writes through
+					// the file system journal
+    void CrashAfter(int writes) { crashCountdown = writes; }
+    					// Stop Nachos dead instead of doing
+					// the "writes"th write from now
+
   private:
     Disk *disk;		  		// Raw disk device
     Semaphore *semaphore; 		// To synchronize requesting thread 
 					// with the interrupt handler
     Lock *lock;		  		// Only one read/write request
 					// can be sent to the disk at a time
+    Journal *journal;			// Holds metadata not yet in place
+    int crashCountdown;			// Writes left before the crash, 
+					// 0 if none is planned
 };
 
 #endif // SYNCHDISK_H
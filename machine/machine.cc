@@ -52,7 +52,7 @@ void CheckEndian()
 //		is executed.
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, int tlbEntries, int tlbAssoc)
 {
     int i;
 
@@ -61,20 +61,67 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    tlbSize = tlbEntries;
+    tlbWays = (tlbAssoc > 0) ? tlbAssoc : tlbEntries;
+    ASSERT(tlbWays <= tlbSize && tlbSize % tlbWays == 0);
+    tlbSets = tlbSize / tlbWays;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
+    tlb = new TranslationEntry[tlbSize];
+    for (i = 0; i < tlbSize; i++)
 	tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else	// use linear page table
+    pageDirectory = NULL;
+#else	// use the page table
     tlb = NULL;
-    pageTable = NULL;
+    pageDirectory = NULL;
 #endif
+    currentAsid = 0;
+    flushOnSwitch = FALSE;
+    for (i = 0; i < NumAsids; i++)
+        asidUsed[i] = FALSE;
     lock = new Lock("Translate");
     singleStep = debug;
     CheckEndian();
 }
 
+//----------------------------------------------------------------------
+// Machine::AllocAsid, FreeAsid
+// 	Hand out the address space identifiers TLB entries are tagged
+//	with.  A freed identifier may be given to a new address space, so
+//	the entries still carrying it are invalidated first.
+//
+// Machine::FlushAsid
+// 	Invalidate the TLB entries of "asid", which stays allocated.
+//----------------------------------------------------------------------
+
+int
+Machine::AllocAsid()
+{
+    for (int i = 0; i < NumAsids; i++)
+        if (!asidUsed[i]) {
+            asidUsed[i] = TRUE;
+            return i;
+        }
+    ASSERT(FALSE);		// too many address spaces
+    return -1;
+}
+
+void
+Machine::FreeAsid(int asid)
+{
+    ASSERT(asidUsed[asid]);
+    FlushAsid(asid);
+    asidUsed[asid] = FALSE;
+}
+
+void
+Machine::FlushAsid(int asid)
+{
+    if (tlb != NULL)
+        for (int i = 0; i < tlbSize; i++)
+            if (tlb[i].asid == asid)
+                tlb[i].valid = FALSE;
+}
+
 //----------------------------------------------------------------------
 // Machine::~Machine
 // 	De-allocate the data structures used to simulate user program execution.
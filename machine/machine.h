@@ -34,7 +34,9 @@
 
 #define NumPhysPages    32
 #define MemorySize 	(NumPhysPages * PageSize)
-#define TLBSize		4		// if there is a TLB, make it small
+#define TLBSize		4		// if there is a TLB, make it small,
+					// unless told otherwise (-tlb)
+#define NumAsids	64		// address spaces the TLB can tell apart
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -107,8 +109,11 @@ class Instruction {
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-				// for running user programs
+    Machine(bool debug, int tlbEntries = TLBSize, int tlbAssoc = 0);
+				// Initialize the simulation of the hardware
+				// for running user programs; the TLB (if
+				// any) has "tlbEntries" entries in sets of
+				// "tlbAssoc" (0: fully associative)
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -147,8 +152,14 @@ class Machine {
     void Debugger();		// invoke the user program debugger
     void DumpState();		// print the user CPU and memory state 
 
-    void TLBSwapFIFO(int address);
-    void TLBSwapLRU(int address);
+    void TLBSwapFIFO(int address);	// Handle a TLB miss, replacing
+    void TLBSwapLRU(int address);	// within the set of the address
+    TranslationEntry *TLBLookup(int vpn, int asid);
+    void InvalidateTLB(int vpn, int asid);
+
+    int AllocAsid();		// Tag for the TLB entries of a new address space
+    void FreeAsid(int asid);	// The address space is gone, so are its entries
+    void FlushAsid(int asid);	// Drop its entries, but keep the identifier
 
 
 // Data structures -- all of these are accessible to Nachos kernel code.
@@ -182,13 +193,33 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
-
-    TranslationEntry *pageTable;
-    unsigned int pageTableSize;
+    int tlbSize;			// number of entries in the TLB,
+    int tlbWays;			// entries per set (tlbSize for a
+    int tlbSets;			// fully associative TLB), and sets
+
+    TranslationEntry **pageDirectory;	// two-level page table (see
+    unsigned int pageTableSize;		// translate.h), and the number of
+					// virtual pages it covers
+
+    TranslationEntry *PageTableEntry(unsigned int vpn) {
+	TranslationEntry *table = pageDirectory[vpn / DirEntryPages];
+	return (table == NULL) ? NULL : &table[vpn % DirEntryPages]; }
+					// Translation of "vpn" < pageTableSize,
+					// NULL if it has no second-level table
+
+    int currentAsid;		// TLB entries only match for the address
+				// space running now, so entries of several
+				// can stay in the TLB across context switches
+    bool flushOnSwitch;		// empty the TLB on every context switch
+				// instead (-noasid), to compare
 
     void *lock;     //should be a really lock from Class Lock, but will meet recursive "include"!
 
   private:
+    int TLBSet(int vpn, int asid);
+    void TLBFill(int address, TranslationEntry *entry);
+
+    bool asidUsed[NumAsids];
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
@@ -22,6 +22,8 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numTLBMisses = numPacketsSent = numPacketsRecvd = 0;
+    numPrefetches = numPrefetchHits = 0;
+    numContextSwitches = 0;
 }
 
 //----------------------------------------------------------------------
@@ -39,6 +41,12 @@ Statistics::Print()
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d, TLB misses %d\n", numPageFaults, numTLBMisses);
+    if (numContextSwitches > 0)
+	printf("Context switches %d, TLB misses per switch %.2f\n",
+	    numContextSwitches, (double) numTLBMisses / numContextSwitches);
+    if (numPrefetches > 0)
+	printf("Prefetch: pages %d, hits %d (%d%%)\n", numPrefetches,
+	    numPrefetchHits, numPrefetchHits * 100 / numPrefetches);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
@@ -34,6 +34,9 @@ class Statistics {
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
     int numTLBMisses;       // number of TLB swaps
+    int numContextSwitches;	// number of switches to a user program
+    int numPrefetches;		// number of pages brought in by fault-around
+    int numPrefetchHits;	// number of those used before being evicted
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
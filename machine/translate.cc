@@ -212,7 +212,6 @@ ExceptionType
 Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 {  
     //printf("%s enter translating!",currentThread->getName());
-    int i;
     unsigned int vpn, offset;
     TranslationEntry *entry;
     unsigned int pageFrame;
@@ -226,8 +225,8 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     }
     
     // we must have either a TLB or a page table, but not both!
-    //ASSERT(tlb == NULL || pageTable == NULL);	
-    //ASSERT(tlb != NULL || pageTable != NULL);	
+    //ASSERT(tlb == NULL || pageDirectory == NULL);	
+    //ASSERT(tlb != NULL || pageDirectory != NULL);	
 
 // calculate the virtual page number, and offset within the page,
 // from the virtual address
@@ -240,22 +239,18 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
 			virtAddr, pageTableSize);
 	    return AddressErrorException;
-	} else if (!pageTable[vpn].valid) {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
-			virtAddr, pageTableSize);
+	}
+	entry = PageTableEntry(vpn);
+	if (entry == NULL || !entry->valid) {
+	    DEBUG('a', "virtual page # %d not in memory!\n", vpn);
 	    return PageFaultException;
 	}
-	entry = &pageTable[vpn];
-       entry->lastAccessTime = stats->totalTicks;  //update access time
     } else {                       //We have a TLB here!
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
-		entry = &tlb[i];			// FOUND!
-		entry->lastAccessTime = stats->totalTicks;  
-		pageTable[vpn].lastAccessTime = stats->totalTicks;     //Update the access time
-		//printf("TLB hit!\n");
-		break;
-	    }
+        entry = TLBLookup(vpn, currentAsid);
+        if (entry != NULL) {				// FOUND!
+	    entry->lastAccessTime = stats->totalTicks;  	// for TLB LRU
+	    //printf("TLB hit!\n");
+	}
 	if (entry == NULL) {				// not found
     	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
            //printf("TLB miss!\n");
@@ -266,7 +261,7 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
-	DEBUG('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
+	DEBUG('a', "%d mapped read-only in TLB!\n", virtAddr);
 	return ReadOnlyException;
     }
     pageFrame = entry->physicalPage;
@@ -285,98 +280,120 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     DEBUG('a', "phys addr = 0x%x\n", *physAddr);
 
     if(tlb!=NULL){
-        pageTable[vpn].dirty=entry->dirty;
-        pageTable[vpn].use=entry->use;
+        TranslationEntry *pte = PageTableEntry(vpn);
+        pte->dirty=entry->dirty;
+        pte->use=entry->use;
     }
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// Machine::TLBSet
+// 	The TLB is set-associative: a translation for "vpn" of address
+//	space "asid" can only be in set TLBSet(vpn, asid), which holds
+//	entries tlb[set * tlbWays] to tlb[set * tlbWays + tlbWays - 1].
+//	Lookup and replacement only look at those, so their cost depends
+//	on the associativity, not on the size of the TLB.
+//----------------------------------------------------------------------
+
+int
+Machine::TLBSet(int vpn, int asid)
+{
+    return (unsigned) (vpn + asid * 31) % tlbSets;
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBLookup
+// 	Return the TLB entry translating "vpn" for address space "asid",
+//	or NULL if there is none.
+//
+// Machine::InvalidateTLB
+// 	Drop that entry, if any, because the translation changed.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+Machine::TLBLookup(int vpn, int asid)
+{
+    TranslationEntry *set = &tlb[TLBSet(vpn, asid) * tlbWays];
+
+    for (int i = 0; i < tlbWays; i++)
+        if (set[i].valid && set[i].virtualPage == vpn && set[i].asid == asid)
+            return &set[i];
+    return NULL;
+}
+
+void
+Machine::InvalidateTLB(int vpn, int asid)
+{
+    TranslationEntry *entry = TLBLookup(vpn, asid);
+
+    if (entry != NULL)
+        entry->valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBSwapFIFO, TLBSwapLRU
+// 	Handle a TLB miss on "address": load the translation from the page
+//	table (faulting the page in first if needed) into its set,
+//	replacing an empty entry, or else the oldest (FIFO) or least
+//	recently used (LRU) entry of the set.
+//
+//	The page manager invalidates TLB entries whenever it changes a
+//	translation, so there are no stale entries to look for here.
+//----------------------------------------------------------------------
+
+void
+Machine::TLBFill(int address, TranslationEntry *entry)
+{
+    unsigned int vpn = address / PageSize;
+    TranslationEntry *pte;
+
+    ASSERT(vpn < pageTableSize);
+    pte = PageTableEntry(vpn);
+    if(pte == NULL || pte->valid ==FALSE){
+        machine->RaiseException(PageFaultException, address);
+        pte = PageTableEntry(vpn);
+    }
+    *entry = *pte;
+    entry->asid = currentAsid;
+    ASSERT(entry->valid==TRUE);
+}
+
 void
 Machine::TLBSwapFIFO(int address)
 {
     DEBUG('a',"TLB MISS, use FIFO swap\n");
-    int vpn = address / PageSize;	
-    int slot=0;
-    int min=tlb[0].comingTime;
-    TranslationEntry *entry = NULL;		
-    for(int i = 0; i< TLBSize;i++){     
-        if(tlb[i].valid == FALSE){      //Found an empty TLB entry
+    TranslationEntry *set = &tlb[TLBSet(address / PageSize, currentAsid) * tlbWays];
+    int slot = 0;
+
+    for(int i = 0; i< tlbWays;i++){     
+        if(set[i].valid == FALSE){      //Found an empty TLB entry
 	    slot = i;
            DEBUG('a',"Slot %d is empty.\n",slot);
 	    break;
 	}		
-       if(tlb[i].comingTime < min){
-	   min = tlb[i].comingTime;
+       if(set[i].comingTime < set[slot].comingTime)
 	   slot = i;
-	 } 
-    }
-    entry = &tlb[slot];
-    //printf("put the miss entry in slot %d\n",slot);
-    /*
-    if(entry->dirty == TRUE){
-        pageTable[entry->virtualPage] = *entry;	   //Write back to the page table	
-        //printf("Swap %d to page table\n",slot);
-    }
-    */
-    if(pageTable[vpn].valid ==FALSE){
-        machine->RaiseException(PageFaultException, address);
-    }
-    *entry = pageTable[vpn];
-    ASSERT(entry->valid==TRUE);
-    for(int i = 0; i< TLBSize;i++){     
-        if(tlb[i].valid ==TRUE && pageTable[tlb[i].virtualPage].valid==FALSE){    
-            tlb[i].valid=FALSE;
-        }
     }
+    TLBFill(address, &set[slot]);
+    set[slot].comingTime = stats->totalTicks;
 }
 
 void
 Machine::TLBSwapLRU(int address){
     DEBUG('a',"TLB MISS, use LRU swap\n");
-    int vpn = address / PageSize;	
+    TranslationEntry *set = &tlb[TLBSet(address / PageSize, currentAsid) * tlbWays];
     int slot = 0;
-    int min = tlb[0].lastAccessTime;				
-    TranslationEntry *entry = NULL;
-    /*
-    //print lastAccessTime
-    for(int i = 0; i< TLBSize;i++){     
-        if(tlb[i].valid != FALSE){      
-	    printf("slot %d, last access time: %d\n",i,tlb[i].lastAccessTime);
-	}
-    }
-    */
-    for(int i = 0; i< TLBSize;i++){     
-        if(tlb[i].valid == FALSE){      //Found an empty TLB entry
+
+    for(int i = 0; i< tlbWays;i++){     
+        if(set[i].valid == FALSE){      //Found an empty TLB entry
 	    slot = i;
            DEBUG('a',"Slot %d is empty.\n",slot);
 	    break;
 	}					    
-       if(tlb[i].lastAccessTime < min){
-	   min = tlb[i].lastAccessTime;
+       if(set[i].lastAccessTime < set[slot].lastAccessTime)
 	   slot = i;
-	 }
-    }
-    entry = &tlb[slot];
-    //printf("put the miss entry in slot %d\n",slot);
-    /*
-    if(entry->valid == TRUE && entry->dirty == TRUE){
-        pageTable[entry->virtualPage] = *entry;	   //Write back to the page table	
-        //printf("Swap %d to page table\n",slot);
     }
-    */
-    if(pageTable[vpn].valid ==FALSE){
-        machine->RaiseException(PageFaultException, address);
-    }
-    *entry = pageTable[vpn];
-    ASSERT(entry->valid==TRUE);
-    for(int i = 0; i< TLBSize;i++){     
-        if(tlb[i].valid ==TRUE && pageTable[tlb[i].virtualPage].valid==FALSE){    
-            tlb[i].valid=FALSE;
-        }
-    }
-    /*
-    printf("TLB\n");
-    for(int i = 0; i< TLBSize;i++){     
-        printf("valid:%d, vpn:%d, ppn:%d, dirty:%d, time:%d\n",tlb[i].valid,tlb[i].virtualPage,tlb[i].physicalPage,tlb[i].dirty,tlb[i].lastAccessTime);
-    }*/
-}
\ No newline at end of file
+    TLBFill(address, &set[slot]);
+    set[slot].lastAccessTime = stats->totalTicks;
+}
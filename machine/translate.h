@@ -27,6 +27,14 @@
 // In addition, there are some extra bits for access control (valid and 
 // read-only) and some bits for usage information (use and dirty).
 
+// Page tables have two levels: a page directory with one entry for
+// each DirEntryPages virtual pages, pointing to an array of their
+// translations, or NULL if none of those pages has been used yet.  Host
+// memory for a page table thus grows with the part of the address space
+// actually touched, not with its size.
+
+#define DirEntryPages	32
+
 class TranslationEntry {
   public:
     int virtualPage;  	// The page number in virtual memory.
@@ -40,8 +48,9 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
-    int lastAccessTime;     //for LRU
-    int comingTime;         //for FIFO
+    int lastAccessTime;     //for TLB LRU
+    int comingTime;         //for TLB FIFO
+    int asid;               //in the TLB, the address space the entry belongs to
 };
 
 #endif
@@ -0,0 +1,38 @@
+/* forkbench.c 
+ *	Fork a number of children from a process with a large, fully
+ *	written data image.  With copy-on-write the cost of each Fork
+ *	doesn't depend on ImageSize any more; compare the total ticks
+ *	printed at Halt for different values of ImageSize.
+ *
+ *	Each child writes one word, so it copies one page only.
+ */
+
+#include "syscall.h"
+
+#define ImageSize	4096		/* bytes of data written before forking */
+#define NumForks	8
+
+int image[ImageSize / sizeof(int)];
+
+void
+child()
+{
+    image[0]++;
+    Exit(image[0]);
+}
+
+int
+main()
+{
+    int i;
+
+    for (i = 0; i < ImageSize / sizeof(int); i++)
+	image[i] = i;
+
+    for (i = 0; i < NumForks; i++) {
+	Fork(child);
+	Yield();
+    }
+    Halt();
+    /* not reached */
+}
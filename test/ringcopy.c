@@ -0,0 +1,85 @@
+/* ringcopy.c
+ *    Copy a file using the batched system call ring, then read the
+ *    copy back and check it is the same.
+ *
+ *    Read and Write always start at the beginning of the file (every
+ *    call opens it anew, see SysRead), so each read batch asks for
+ *    BufSize more bytes than the last, until Read returns less than it
+ *    asked for: then the buffer holds the whole file.  Apart from
+ *    those, the copy takes two Enter traps instead of one trap per
+ *    Create/Open/Read/Write/Close.
+ */
+
+#include "syscall.h"
+
+#define BufSize 256
+#define MaxCopy (16 * BufSize)	/* biggest file we can copy */
+
+SyscallRing ring;
+char buffer[MaxCopy], check[MaxCopy];
+
+RingEntry *
+Submit(int op, int arg1, int arg2, int arg3)
+{
+    RingEntry *e = &ring.entries[ring.tail % RingSize];
+
+    e->op = op;
+    e->arg1 = arg1;
+    e->arg2 = arg2;
+    e->arg3 = arg3;
+    e->result = -1;
+    ring.tail++;
+    return e;
+}
+
+/* Read all of the file "id" into "buf", in batches; -1 if too big */
+int
+ReadAll(char *buf, int id)
+{
+    RingEntry *rd;
+    int size;
+
+    for (size = BufSize; size <= MaxCopy; size += BufSize) {
+        rd = Submit(SC_Read, (int) buf, size, id);
+        Enter(&ring);
+        if (rd->result < size)
+            return rd->result;
+    }
+    return -1;
+}
+
+int
+main()
+{
+    RingEntry *src, *dst, *wr;
+    int length, i;
+
+    /* first batch: open the source, create and open the destination */
+    src = Submit(SC_Open, (int) "sort", 0, 0);
+    Submit(SC_Create, (int) "sortcopy", 0, 0);
+    dst = Submit(SC_Open, (int) "sortcopy", 0, 0);
+    Enter(&ring);
+    if (src->result == -1 || dst->result == -1)
+        Exit(-1);
+
+    /* then read the source */
+    length = ReadAll(buffer, src->result);
+    if (length < 0)
+        Exit(-1);
+
+    /* last batch: write it out and close both files */
+    wr = Submit(SC_Write, (int) buffer, length, dst->result);
+    Submit(SC_Close, src->result, 0, 0);
+    Submit(SC_Close, dst->result, 0, 0);
+    Enter(&ring);
+    if (wr->result != length)
+        Exit(-1);
+
+    /* the copy must be as long as the source, and the same */
+    if (ReadAll(check, dst->result) != length)
+        Exit(-1);
+    for (i = 0; i < length; i++)
+        if (check[i] != buffer[i])
+            Exit(-1);
+    Exit(0);
+}
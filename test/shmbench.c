@@ -0,0 +1,98 @@
+/* shmbench.c 
+ *	Producer/consumer throughput.  The producer forks a consumer and
+ *	hands it NumChunks chunks of ChunkSize words, one at a time,
+ *	through a shared memory segment: no system call is needed to pass
+ *	the data, only Yield while the other side is behind.
+ *
+ *	With UseFiles set to 1 the same chunks go through a file instead
+ *	(and the acknowledgements through a second one), with a Write and
+ *	at least one Read per chunk.  Compare the total ticks printed at
+ *	Halt for both settings.
+ */
+
+#include "syscall.h"
+
+#define UseFiles	0
+#define Key		42		/* name of the shared segment */
+#define ChunkSize	30		/* words per chunk */
+#define NumChunks	64
+
+typedef struct {
+    int seq;			/* number of the chunk in data, 0 if none */
+    int ack;			/* last chunk the consumer is done with */
+    int data[ChunkSize];
+} Channel;			/* exactly one page */
+
+Channel local;			/* the channel when it goes through files */
+OpenFileId chunkFile, ackFile;
+
+Channel *
+OpenChannel()
+{
+    if (UseFiles)
+	return &local;
+    return (Channel *) ShmAttach(ShmCreate(Key, sizeof(Channel)));
+}
+
+void
+consumer()
+{
+    Channel *c = OpenChannel();
+    int k, i, sum = 0;
+
+    for (k = 1; k <= NumChunks; k++) {
+	if (UseFiles) {
+	    while (Read((char *) c, sizeof(Channel), chunkFile) <= 0 ||
+		   c->seq != k)
+		Yield();
+	} else {
+	    while (c->seq != k)
+		Yield();
+	}
+	for (i = 0; i < ChunkSize; i++)
+	    sum += c->data[i];
+	c->ack = k;
+	if (UseFiles)
+	    Write((char *) &c->ack, sizeof(int), ackFile);
+    }
+    Print((char *) sum, 0);
+    Halt();
+    /* not reached */
+}
+
+int
+main()
+{
+    Channel *c;
+    int k, i, ack;
+
+    if (UseFiles) {
+	Create("chunks");
+	Create("acks");
+	chunkFile = Open("chunks");
+	ackFile = Open("acks");
+	Write((char *) &local, sizeof(Channel), chunkFile);
+	Write((char *) &local.ack, sizeof(int), ackFile);
+    }
+    c = OpenChannel();
+    if (c == 0)
+	Exit(-1);
+    Fork(consumer);
+
+    for (k = 1; k <= NumChunks; k++) {
+	if (UseFiles) {
+	    while (Read((char *) &ack, sizeof(int), ackFile) <= 0 ||
+		   ack != k - 1)
+		Yield();
+	} else {
+	    while (c->ack != k - 1)
+		Yield();
+	}
+	for (i = 0; i < ChunkSize; i++)
+	    c->data[i] = k * ChunkSize + i;
+	c->seq = k;
+	if (UseFiles)
+	    Write((char *) c, sizeof(Channel), chunkFile);
+    }
+    Exit(0);
+}
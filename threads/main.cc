@@ -9,9 +9,12 @@
 // 	Most of this file is not needed until later assignments.
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
-//		-p <nachos file> -r <nachos file> -l -D -t
+//		-s -noasid -tlb <entries> <ways>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
+//		-f -lfs -cp <unix file> <nachos file>
+//		-p <nachos file> -r <nachos file> -l -D -t -td [<files>]
+//		-tw <writes>
+//		-crash <disk writes> -check
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
 //              -z
@@ -22,17 +25,28 @@
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -noasid flushes the TLB on every context switch instead of
+//	keeping the entries of each address space apart
+//    -tlb sets the number of TLB entries and their associativity
+//	(0 ways: fully associative), for a USE_TLB build
 //    -x runs a user program
 //    -c tests the console
 //
 //  FILESYS
 //    -f causes the physical disk to be formatted
+//    -lfs with -f, formats it so that file data is written log-structured
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
 //    -t tests the performance of the Nachos file system
+//    -td tests creating and looking up many files in a directory,
+//	that many or a few sizes up to what the disk holds
+//    -tw times small writes at random places in a file
+//    -crash changes the file system until the given disk write, then
+//	stops dead; run nachos again without -f to recover the disk
+//    -check checks that the bitmap marks just the sectors of the files
 //
 //  NETWORK
 //    -n sets the network reliability
@@ -60,7 +74,8 @@ extern int testnum;
 // External functions used by this file
 
 extern void ThreadTest(void), Copy(char *unixFile, char *nachosFile);
-extern void Print(char *file), PerformanceTest(void);
+extern void Print(char *file), PerformanceTest(void), DirectoryTest(int files);
+extern void CrashTest(int writes), RandomWriteTest(int writes);
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out);
 extern void MailTest(int networkID);
 
@@ -157,6 +172,22 @@ main(int argc, char **argv)
             fileSystem->Print();
 	} else if (!strcmp(*argv, "-t")) {	// performance test
             PerformanceTest();
+	} else if (!strcmp(*argv, "-td")) {	// directory test
+	    if (argc > 1 && atoi(*(argv + 1)) > 0) {
+		DirectoryTest(atoi(*(argv + 1)));
+		argCount = 2;
+	    } else
+		DirectoryTest(0);
+	} else if (!strcmp(*argv, "-tw")) {	// random write test
+	    ASSERT(argc > 1);
+            RandomWriteTest(atoi(*(argv + 1)));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-crash")) {	// die in the middle
+	    ASSERT(argc > 1);
+            CrashTest(atoi(*(argv + 1)));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-check")) {	// fsck
+            fileSystem->Check();
 	}
 #endif // FILESYS
 #ifdef NETWORK
@@ -170,7 +201,6 @@ main(int argc, char **argv)
         }
 #endif // NETWORK
     }
-
     currentThread->Finish();	// NOTE: if the procedure "main" 
 				// returns, then the program "nachos"
 				// will exit (as any other normal program
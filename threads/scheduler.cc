@@ -130,30 +130,54 @@ Scheduler::FindNextBlocked()
 
 #ifdef USER_PROGRAM
 //by LMX
-void
-Scheduler::ActiveOne()
+//the first suspended thread stays first while it doesn't fit, so that
+//smaller ones can't keep a big one out for good
+bool
+Scheduler::ActiveOne(int frames)
 {
     Thread *next = (Thread *)suspendList->Remove();
-    if(next!=NULL){
-        next->Active();
-        return ;
+    if(next==NULL)
+        return FALSE;
+    if(next->space->getResidentLimit() > frames){
+        suspendList->Prepend((void *)next);
+        return FALSE;
     }
+    next->Active();
+    return TRUE;
 }
 
-//suspend blocked first, then ready
-void
-Scheduler::SuspendOne()
+//take the first user program on "list" with status "status" off it,
+//leaving the other threads in order
+static Thread *
+TakeUserThread(List *list, ThreadStatus status)
 {
-    Thread *next = FindNextBlocked();
-    if(next!=NULL){
-        next->Suspend();
-        return ;
-    }
-    next = FindNextToRun();
-    if(next!=NULL){
-        next->Suspend();
-        return ;
+    List *rest = new List;
+    Thread *found = NULL, *t;
+
+    while ((t = (Thread *)list->Remove()) != NULL) {
+        if (found == NULL && t->getStatusValue() == status && t->space != NULL)
+            found = t;
+        else
+            rest->Append((void *)t);
     }
+    while ((t = (Thread *)rest->Remove()) != NULL)
+        list->Append((void *)t);
+    delete rest;
+    return found;
+}
+
+//suspend blocked first, then ready; only user programs have
+//memory to give back.  Returns FALSE if there is nobody to suspend.
+bool
+Scheduler::SuspendOne()
+{
+    Thread *next = TakeUserThread(blockedList, BLOCKED);
+    if(next==NULL)
+        next = TakeUserThread(readyList, READY);
+    if(next==NULL)
+        return FALSE;
+    next->Suspend();
+    return TRUE;
 }
     
 #endif
@@ -213,6 +237,7 @@ Scheduler::Run (Thread *nextThread)
     
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
+        stats->numContextSwitches++;
         currentThread->RestoreUserState();     // to restore, do it.
         currentThread->space->RestoreState();
     }
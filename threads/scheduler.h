@@ -37,8 +37,9 @@ class Scheduler {
     //List* getSuspendReadyList(){return suspend_readyList;}
     //List* getSuspendBlockedList(){return suspend_blockedList;}
     List* getSuspendList(){return suspendList;}
-    void ActiveOne();
-    void SuspendOne();
+    bool ActiveOne(int frames);	// activate the first suspended thread,
+					// if its resident set fits in "frames"
+    bool SuspendOne();
 #endif
 
   private:
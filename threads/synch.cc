@@ -98,8 +98,7 @@ Semaphore::V()
         else{
             ASSERT(thread->getStatusValue()==BLOCKED_SUSPEND);
             printf("Thread %s changes status from %s to READY_SUSPEND\n",thread->getName(),thread->getStatus());
-            thread->setStatus(READY_SUSPEND);
-            scheduler->getSuspendList()->Append((void *)thread);
+            thread->setStatus(READY_SUSPEND);   // it is already on the suspend list
             ThreadShow();
         }
 #endif
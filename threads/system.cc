@@ -72,6 +72,24 @@ TimerInterruptHandler(int dummy)
 	interrupt->YieldOnReturn();
 }
 
+#ifdef USER_PROGRAM
+//----------------------------------------------------------------------
+// TLBShapeOK
+// 	Check the arguments of -tlb before Machine is built on them:
+//	"entries" TLB entries, in sets of "ways" (0: a single set, fully
+//	associative), which must divide them.
+//----------------------------------------------------------------------
+
+static bool
+TLBShapeOK(int entries, int ways)
+{
+    if (ways == 0)
+        ways = entries;
+    return entries > 0 && ways > 0 && ways <= entries
+        && entries % ways == 0;
+}
+#endif
+
 //----------------------------------------------------------------------
 // Initialize
 // 	Initialize Nachos global data structures.  Interpret command
@@ -91,9 +109,13 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    bool noAsid = FALSE;	// flush the TLB on context switches
+    int tlbEntries = TLBSize;	// TLB size and associativity
+    int tlbAssoc = 0;
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
+    bool logStructured = FALSE;	// ... with the log-structured layout
 #endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
@@ -119,10 +141,24 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	if (!strcmp(*argv, "-noasid"))
+	    noAsid = TRUE;
+	if (!strcmp(*argv, "-tlb")) {
+	    if (argc < 3 || !TLBShapeOK(atoi(*(argv + 1)), atoi(*(argv + 2)))) {
+		printf("Usage: -tlb <entries> <ways>, entries > 0, ways "
+		       "dividing them (0: fully associative)\n");
+		Exit(1);
+	    }
+	    tlbEntries = atoi(*(argv + 1));
+	    tlbAssoc = atoi(*(argv + 2));
+	    argCount = 3;
+	}
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
 	    format = TRUE;
+	if (!strcmp(*argv, "-lfs"))
+	    logStructured = TRUE;
 #endif
 #ifdef NETWORK
 	if (!strcmp(*argv, "-l")) {
@@ -163,7 +199,8 @@ Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
+    machine = new Machine(debugUserProg, tlbEntries, tlbAssoc);	// this must come first
+    machine->flushOnSwitch = noAsid;
     //by LMX
     pageManager = new PageManager();
 #endif
@@ -175,7 +212,7 @@ Initialize(int argc, char **argv)
 #endif
 
 #ifdef FILESYS_NEEDED
-    fileSystem = new FileSystem(format);
+    fileSystem = new FileSystem(format, logStructured);
 #endif
 
 #ifdef NETWORK
@@ -191,6 +228,13 @@ void
 Cleanup()
 {
     printf("\nCleaning up...\n");
+#ifdef FILESYS
+    // Write what the journal holds in place.  That may block on the
+    // disk and switch back to us; we may be a finished thread halting
+    // from Idle, whose stack Scheduler::Run would then free.  Keep it.
+    threadToBeDestroyed = NULL;
+    fileSystem->Sync();
+#endif
 #ifdef NETWORK
     delete postOffice;
 #endif
@@ -400,10 +400,8 @@ Thread::Suspend()
 {
     printf("Now %d physical pages left\n",pageManager->numClean());
     printf("Suspend called!\n");
-    this->space->SwapOut();
-    printf("Now %d physical pages left\n",pageManager->numClean());
     printf("Thread %s changes status from %s ",name,getStatus());
-    ASSERT(status== READY || BLOCKED);
+    ASSERT(status== READY || status== BLOCKED);
     scheduler->getSuspendList()->Append((void *)this);
     if(status==READY){
         status=READY_SUSPEND;
@@ -411,6 +409,10 @@ Thread::Suspend()
         status=BLOCKED_SUSPEND;
     }
     printf("to %s\n",getStatus());
+    //change the status first: writing the pages back may block us, and
+    //we mustn't be put back on the ready list meanwhile
+    this->space->SwapOut();
+    printf("Now %d physical pages left\n",pageManager->numClean());
     ThreadShow();
 }
 
@@ -419,7 +421,9 @@ Thread::Active()
 {
     printf("Active called!\n");
     printf("Thread %s changes status from %s ",name,getStatus());
-    ASSERT(status==READY_SUSPEND || BLOCKED_SUSPEND);
+    ASSERT(status==READY_SUSPEND || status==BLOCKED_SUSPEND);
+    if(space!=NULL)
+        space->SwapIn();
     if(status==READY_SUSPEND){
         scheduler->ReadyToRun(this);
     }else{
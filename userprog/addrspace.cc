@@ -18,7 +18,6 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
@@ -45,6 +44,37 @@ SwapHeader (NoffHeader *noffH)
 	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
 }
 
+//----------------------------------------------------------------------
+// Overlaps
+//      Does segment "seg" have any byte in virtual page "vpn"?
+//
+// ClassifyPage
+//      Work out from the segment boundaries what page "vpn" holds: a
+//      page within the code segment only is a CodePage, one with any
+//      initialized data a DataPage, anything else (bss, stack) a
+//      ZeroPage that never has to be read from disk.
+//----------------------------------------------------------------------
+
+static bool
+Overlaps(Segment *seg, int vpn)
+{
+    return seg->size > 0 && seg->virtualAddr < (vpn + 1) * PageSize &&
+           seg->virtualAddr + seg->size > vpn * PageSize;
+}
+
+static PageType
+ClassifyPage(NoffHeader *noffH, int vpn)
+{
+    if (Overlaps(&noffH->initData, vpn))
+        return DataPage;
+    if (!Overlaps(&noffH->code, vpn))
+        return ZeroPage;
+    if (noffH->code.virtualAddr <= vpn * PageSize &&
+            noffH->code.virtualAddr + noffH->code.size >= (vpn + 1) * PageSize)
+        return CodePage;
+    return DataPage;    // code that shares its page with zeros
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
@@ -57,13 +87,14 @@ SwapHeader (NoffHeader *noffH)
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
 //
-//	"executable" is the file containing the object code to load into memory
+//	"executable" is the file containing the object code to load into memory;
+//	the address space keeps it open, pages are read from it on demand,
+//	and deletes it when it goes away
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace(OpenFile *executable)
 {
-    NoffHeader noffH;
-    unsigned int i, size;
+    unsigned int size;
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
     if ((noffH.noffMagic != NOFFMAGIC) && 
@@ -82,36 +113,32 @@ AddrSpace::AddrSpace(OpenFile *executable)
 						// at least until we have
 						// virtual memory
 						
-    //We use fixed allocation strategy, now each thread can have up to 8 physical pages
-    availNumPages = NumPhysPages/4;
+    //Each process starts with 8 physical pages; the page-fault-frequency
+    //policy of the page manager grows and shrinks that from there on
+    residentLimit = availNumPages = InitialResident;
+    lastFaultTime = stats->totalTicks;
+    pageManager->reserveFrames(residentLimit);
+    asid = machine->AllocAsid();
     DEBUG('a', "Initializing address space, num pages %d, size %d\n", 
 					numPages, size);
 // first, set up the translation 
-    pageTable = new TranslationEntry[numPages];
-    for (i = 0; i < numPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virtual page # = phys page #
-	//pageTable[i].physicalPage = i;
-	pageTable[i].physicalPage = -1;
-	//by LMX
-	/*
-	int phynum = pageManager->findPage();
-       ASSERT(phynum>=0 && phynum<NumPhysPages);
-       pageManager->markPage(phynum);
-	pageTable[i].physicalPage = phynum;
-       printf("vpn:%d goes to ppn:%d allocated\n",i,phynum);
-       */
-       
-       //We use lazy-loading now!,so no page is valid!
-	//pageTable[i].valid = TRUE;
-       pageTable[i].valid = FALSE;
-       pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  // if the code segment was entirely on 
-					// a separate page, we could set its 
-					// pages to be read-only
-	 pageTable[i].lastAccessTime = 0;
+    //We use lazy-loading now!, so no page is valid, and the second-level
+    //tables only come with the first page fault in their range
+    numDirEntries = divRoundUp(numPages, DirEntryPages);
+    pageDirectory = new TranslationEntry *[numDirEntries];
+    pageInfo = new PageInfo *[numDirEntries];
+    for (int dir = 0; dir < numDirEntries; dir++) {
+        pageDirectory[dir] = NULL;
+        pageInfo[dir] = NULL;
     }
     //printf("%d physical pages left\n",pageManager->numClean());
+
+    //by LMX
+    //No page has been swapped out yet, all of them come from the executable
+    execFile = executable;
+    lastFault = faultStride = faultAround = 0;
+    mmapBase = numPages;
+    regions = NULL;
     
 // zero out the entire address space, to zero the unitialized data segment 
 // and the stack segment
@@ -161,41 +188,148 @@ AddrSpace::AddrSpace(OpenFile *executable)
 
 AddrSpace::AddrSpace(int _tid, void* _fatherSpace){
     AddrSpace* fatherSpace =(AddrSpace*) _fatherSpace;
-    numPages = fatherSpace->numPages;
-    pageTable = new TranslationEntry[numPages];                    
-    availNumPages = NumPhysPages/4;
-    for (int i = 0; i < numPages; i++) {
-        pageTable[i].virtualPage = i;   
-        pageTable[i].physicalPage = -1; 
-        pageTable[i].valid = FALSE;    
-        pageTable[i].use = FALSE;            
-        pageTable[i].dirty = FALSE;
-        pageTable[i].readOnly = FALSE; 
-        pageTable[i].lastAccessTime = 0;
+    DEBUG('a', "Forking the address space for thread %d\n", _tid);
+    //mapped files are not inherited, the child gets the program only
+    numPages = mmapBase = fatherSpace->mmapBase;
+    regions = NULL;
+    numDirEntries = divRoundUp(numPages, DirEntryPages);
+    pageDirectory = new TranslationEntry *[numDirEntries];
+    pageInfo = new PageInfo *[numDirEntries];
+    for (int i = 0; i < numDirEntries; i++) {
+        pageDirectory[i] = NULL;
+        pageInfo[i] = NULL;
     }
+    residentLimit = availNumPages = InitialResident;
+    lastFaultTime = stats->totalTicks;
+    asid = machine->AllocAsid();
 
-    filename=new char[10];//[FileNameMaxLen+1];
-    char tid[3];
-    sprintf(tid,"%d",_tid);    
-    strcpy(filename,fatherSpace->filename);
-    strcat(filename,"_");
-    strcat(filename,tid);
-    
-    printf("forked filename: %s\n",filename);
-    //Create the swap file and copy it from its father
-    fileSystem->Create(filename, numPages * PageSize);
-    fileSystem->Copy(fatherSpace->filename, filename, numPages * PageSize);
-
-    OpenFile * fileHandler = fileSystem->Open(filename);
-    //write back dirty pages of the father
-    for (int vpn = 0; vpn < numPages; vpn++){
-        if (fatherSpace->pageTable[vpn].dirty==TRUE){
-            int fatherppn = fatherSpace->pageTable[vpn].physicalPage;
-            fileHandler->WriteAt(&(machine->mainMemory[fatherppn * PageSize]), PageSize, vpn * PageSize);
+    //The child runs the same executable and shares everything else
+    //copy-on-write with its father: the swap slots of the father, and
+    //his resident pages.  Nothing is copied until somebody writes.
+    //The shared pages count in the child's resident set too, so its
+    //limit is at least their number (the father's may have grown
+    //past InitialResident); the policy shrinks it later if need be.
+    noffH = fatherSpace->noffH;
+    execFile = new OpenFile(fatherSpace->getExecSector());
+    lastFault = faultStride = faultAround = 0;
+    for (int vpn = 0; vpn < (int) numPages; vpn++){
+        int slot = fatherSpace->getSwapSlot(vpn);
+        if (slot != -1) {
+            setSwapSlot(vpn, slot);
+            pageManager->shareSwapSlot(slot);
+        }
+    }
+    pageManager->shareAll(fatherSpace, this);
+    if (availNumPages < 0) {
+        residentLimit -= availNumPages;
+        availNumPages = 0;
+    }
+    pageManager->reserveFrames(residentLimit);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocPageTable
+//      Create the second-level page table (and page information) for
+//      directory entry "dir": DirEntryPages pages, none of them valid.
+//
+// AddrSpace::getPageEntry, findPageEntry
+//      The translation of virtual page "vpn".  getPageEntry creates the
+//      second-level table if there is none yet; findPageEntry returns
+//      NULL then, the page was never touched.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::AllocPageTable(int dir)
+{
+    TranslationEntry *table = new TranslationEntry[DirEntryPages];
+    PageInfo *info = new PageInfo[DirEntryPages];
+
+    for (int i = 0; i < DirEntryPages; i++) {
+        table[i].virtualPage = dir * DirEntryPages + i;
+        table[i].physicalPage = -1;
+        table[i].valid = FALSE;
+        table[i].use = FALSE;
+        table[i].dirty = FALSE;
+        table[i].readOnly = FALSE;
+        table[i].lastAccessTime = 0;
+        info[i].swapSlot = -1;
+        info[i].prefetched = FALSE;
+    }
+    pageDirectory[dir] = table;
+    pageInfo[dir] = info;
+}
+
+TranslationEntry *
+AddrSpace::getPageEntry(int vpn)
+{
+    ASSERT(vpn >= 0 && vpn < (int) numPages);
+    if (pageDirectory[vpn / DirEntryPages] == NULL)
+        AllocPageTable(vpn / DirEntryPages);
+    return &pageDirectory[vpn / DirEntryPages][vpn % DirEntryPages];
+}
+
+TranslationEntry *
+AddrSpace::findPageEntry(int vpn)
+{
+    TranslationEntry *table = pageDirectory[vpn / DirEntryPages];
+
+    return (table == NULL) ? NULL : &table[vpn % DirEntryPages];
+}
+
+int
+AddrSpace::getSwapSlot(int vpn)
+{
+    PageInfo *info = pageInfo[vpn / DirEntryPages];
+
+    return (info == NULL) ? -1 : info[vpn % DirEntryPages].swapSlot;
+}
+
+void
+AddrSpace::setSwapSlot(int vpn, int slot)
+{
+    getPageEntry(vpn);
+    pageInfo[vpn / DirEntryPages][vpn % DirEntryPages].swapSlot = slot;
+}
+
+PageType
+AddrSpace::getPageType(int vpn)
+{
+    if (vpn >= (int) mmapBase)
+        return MappedPage;
+    return ClassifyPage(&noffH, vpn);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ResizePageTable
+//      Make the address space "pages" pages long, growing the page
+//      directory if needed.  Second-level tables are kept when it
+//      shrinks, since the frame table may point into them.  If we are
+//      running, the machine has to see the new size right away.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ResizePageTable(int pages)
+{
+    int dirEntries = divRoundUp(pages, DirEntryPages);
+
+    if (dirEntries > numDirEntries) {
+        TranslationEntry **newDirectory = new TranslationEntry *[dirEntries];
+        PageInfo **newInfo = new PageInfo *[dirEntries];
+        for (int i = 0; i < dirEntries; i++) {
+            newDirectory[i] = (i < numDirEntries) ? pageDirectory[i] : NULL;
+            newInfo[i] = (i < numDirEntries) ? pageInfo[i] : NULL;
         }
+        delete [] pageDirectory;
+        delete [] pageInfo;
+        pageDirectory = newDirectory;
+        pageInfo = newInfo;
+        numDirEntries = dirEntries;
     }
-    delete fileHandler;
+    numPages = pages;
+    if (currentThread->space == this)
+        RestoreState();
 }
+
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
 // 	Dealloate an address space.  Nothing for now!
@@ -204,11 +338,28 @@ AddrSpace::AddrSpace(int _tid, void* _fatherSpace){
 AddrSpace::~AddrSpace()
 {
    //by LMX
-   //fileSystem->Remove(filename);
-   for(int i = 0;i < numPages;i++)
-        if(pageTable[i].valid==TRUE)
-            pageManager->cleanPage(pageTable[i].physicalPage);
-   delete pageTable;
+   while(regions != NULL)
+        RemoveRegion(regions->firstVpn * PageSize, regions->shmId != -1);
+   pageManager->shmRelease(this);
+   for(int dir = 0;dir < numDirEntries;dir++){
+        if(pageDirectory[dir] == NULL)
+            continue;
+        for(int i = 0;i < DirEntryPages;i++){
+            if(pageDirectory[dir][i].valid==TRUE){
+                CheckPrefetch(dir * DirEntryPages + i, FALSE);
+                pageManager->unmapPage(pageDirectory[dir][i].physicalPage, this);
+            }
+            if(pageInfo[dir][i].swapSlot != -1)
+                pageManager->freeSwapSlot(pageInfo[dir][i].swapSlot);
+        }
+        delete [] pageDirectory[dir];
+        delete [] pageInfo[dir];
+   }
+   delete [] pageDirectory;
+   delete [] pageInfo;
+   delete execFile;
+   pageManager->releaseFrames(residentLimit);
+   machine->FreeAsid(asid);
 }
 
 //----------------------------------------------------------------------
@@ -254,7 +405,7 @@ AddrSpace::InitRegisters()
 void 
 AddrSpace::SaveState() 
 {
-    //pageTable = machine->pageTable;
+    //pageDirectory = machine->pageDirectory;
     //numPages = machine->pageTableSize;
 }
 
@@ -270,10 +421,13 @@ void
 AddrSpace::RestoreState() 
 {
     //printf("Change Pagetable to %s\n", currentThread->getName());
-    machine->pageTable = pageTable;
+    machine->pageDirectory = pageDirectory;
     machine->pageTableSize = numPages;
-    if(machine->tlb!=NULL){
-        for (int i = 0; i < TLBSize; i++)
+    machine->currentAsid = asid;
+    //with ASIDs the entries of other address spaces just don't match;
+    //flushing is only left for comparison
+    if(machine->tlb!=NULL && machine->flushOnSwitch){
+        for (int i = 0; i < machine->tlbSize; i++)
 	    machine->tlb[i].valid = FALSE;
     }
 }
@@ -282,7 +436,7 @@ AddrSpace::RestoreState()
 int 
 AddrSpace::AddrTrans ( int virtAddr)
 {
-	return pageTable[virtAddr/PageSize].physicalPage * PageSize + (virtAddr %PageSize);
+	return getPageEntry(virtAddr/PageSize)->physicalPage * PageSize + (virtAddr %PageSize);
 }
 
 int 
@@ -291,54 +445,330 @@ AddrSpace::getStackReg()
     return machine->registers[StackReg];
 }
 
-//Write the Executable file into a file, so we can load them when we meet a pagefault
-char Buffer[0x10000];  //create a large buffer
+//----------------------------------------------------------------------
+// ReadSegment
+//      Read the part of segment "seg" that falls into the "count" virtual
+//      pages from "vpn" on from "executable" into "into", which holds
+//      those pages, with a single ReadAt.
+//----------------------------------------------------------------------
 
-void 
-AddrSpace::CreateTempFile(OpenFile *executable, char *tempfile, int filesize)
+static void
+ReadSegment(OpenFile *executable, Segment *seg, int vpn, int count, char *into)
 {
-    NoffHeader noffH;
-    executable -> ReadAt((char *)&noffH, sizeof(noffH), 0);
-    if ((noffH.noffMagic != NOFFMAGIC) && (WordToHost(noffH.noffMagic) == NOFFMAGIC))
-    	SwapHeader(&noffH);
-    ASSERT(noffH.noffMagic == NOFFMAGIC);
-    //read the original executable file to the buffer
-    memset(Buffer, 0, sizeof(Buffer));
-    if (noffH.code.size > 0) {
-        executable -> ReadAt(Buffer, noffH.code.size, noffH.code.inFileAddr);
-    }
-    if (noffH.initData.size > 0) {
-        executable -> ReadAt(Buffer + noffH.code.size, noffH.initData.size, noffH.initData.inFileAddr);
+    int pageStart = vpn * PageSize;
+    int start = max(pageStart, seg->virtualAddr);
+    int end = min(pageStart + count * PageSize, seg->virtualAddr + seg->size);
+
+    if (seg->size > 0 && start < end)
+        executable->ReadAt(into + (start - pageStart), end - start,
+                           seg->inFileAddr + (start - seg->virtualAddr));
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadFromExecutable
+//      Fill in virtual pages "vpn" to "vpn" + "count" - 1, which have
+//      never been written to the swap area, straight from the executable:
+//      the code and initialized data they overlap are read in, everything
+//      else is zero.  Bss or stack pages are just zeroed, without
+//      touching the disk.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadFromExecutable(int vpn, char *into, int count)
+{
+    bool zero = TRUE;
+
+    bzero(into, count * PageSize);
+    for (int i = vpn; i < vpn + count; i++)
+        if (getPageType(i) != ZeroPage)
+            zero = FALSE;
+    if (zero)
+        return;
+    ReadSegment(execFile, &noffH.code, vpn, count, into);
+    ReadSegment(execFile, &noffH.initData, vpn, count, into);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FaultAround
+//      Fault-around policy, called on each page fault at "vpn".  When
+//      the faults come at a constant stride (at most MaxFaultStride
+//      pages), the pages that would fault next are brought in right
+//      away; the window doubles while the pattern holds, up to
+//      MaxFaultAround, and is halved whenever a prefetched page turns
+//      out to be unused (see CheckPrefetch).  Any other fault closes it.
+//
+//      Returns the number of pages to prefetch, and their distance in
+//      "stride".
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FaultAround(int vpn, int *stride)
+{
+    int distance = vpn - lastFault;
+
+    if (distance != 0 && distance == faultStride &&
+            distance >= -MaxFaultStride && distance <= MaxFaultStride)
+        faultAround = (faultAround == 0) ? 1 : min(2 * faultAround, MaxFaultAround);
+    else
+        faultAround = 0;
+    faultStride = distance;
+    lastFault = vpn;
+    *stride = distance;
+    return faultAround;
+}
+
+// A prefetched page stands in for the fault it saved: the next fault
+// of the pattern is expected one stride after it.
+void
+AddrSpace::setPrefetched(int vpn)
+{
+    getPageEntry(vpn);
+    pageInfo[vpn / DirEntryPages][vpn % DirEntryPages].prefetched = TRUE;
+    lastFault = vpn;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CheckPrefetch
+//      Called before the "use" bit of a resident page "vpn" is cleared,
+//      or before it leaves memory ("evicting").  A prefetched page that
+//      has been used by now counts as a prefetch hit; one that is thrown
+//      away unused shrinks the fault-around window.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::CheckPrefetch(int vpn, bool evicting)
+{
+    PageInfo *info = pageInfo[vpn / DirEntryPages];
+
+    if (info == NULL || !info[vpn % DirEntryPages].prefetched)
+        return;
+    if (findPageEntry(vpn)->use) {
+        stats->numPrefetchHits++;
+        info[vpn % DirEntryPages].prefetched = FALSE;
+    } else if (evicting) {
+        faultAround /= 2;
+        info[vpn % DirEntryPages].prefetched = FALSE;
     }
-    //create a new file    
-    fileSystem -> Create(tempfile, filesize);    
-    //write the data to the new file
-    OpenFile *tempexe = fileSystem -> Open(tempfile);
-    tempexe -> WriteAt(Buffer, filesize, 0);
-    delete tempexe;  
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::SwapOut
+//      Give back every physical page of this address space, writing the
+//      dirty ones to the swap area, and take our resident set out of the
+//      memory demand while we are suspended.  A page in the middle of
+//      being read or written stays.
+//      We keep our ASID, so it can't be handed to another address
+//      space; only its TLB entries go.
+//
+// AddrSpace::SwapIn
+//      We are active again; the pages come back by demand paging.
+//----------------------------------------------------------------------
+
 void
 AddrSpace::SwapOut()
 {
-   for(int i = 0;i < numPages;i++){
-        if(pageTable[i].valid==TRUE){
-            int phynum, vpn;
-            vpn=pageTable[i].virtualPage;
-            phynum=pageTable[i].physicalPage;
-            printf("Page %d will be swapped out!\n",phynum);
-            pageTable[i].valid = FALSE;
-     
-            //open file and write memory data, if the page is dirty
-            if(pageTable[i].dirty == TRUE){  
-                printf("Page %d is dirty, write back to %s\n",phynum, filename);       
-                OpenFile *executable = fileSystem -> Open(filename);     
-                executable ->WriteAt(&(machine ->mainMemory[phynum * PageSize]), PageSize, vpn * PageSize);
-                delete executable;
-            }
-            //clean the page
-            pageManager->cleanPage(phynum);  
+   for(int i = 0;i < (int) numPages;i++){
+        TranslationEntry *entry = findPageEntry(i);
+        if(entry!=NULL && entry->valid==TRUE && !pageManager->isPinned(entry->physicalPage)){
+            printf("Page %d will be swapped out!\n",entry->physicalPage);
+            pageManager->swapPage(entry->physicalPage);
         }
    }
-   setAvailPageNum(NumPhysPages/4);
-}
\ No newline at end of file
+   pageManager->releaseFrames(residentLimit);
+   machine->FlushAsid(asid);
+}
+
+void
+AddrSpace::SwapIn()
+{
+   pageManager->reserveFrames(residentLimit);
+   lastFaultTime = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Mmap
+//      Map "length" bytes of the file whose header is at "fileSector",
+//      from "offset" on, into the address space.  Mappings go above the
+//      stack, one after the other.  Nothing is read now: the pages are
+//      faulted in straight from the sectors of the file, without going
+//      through the file cache, and dirty ones are written back to it
+//      when they are evicted or unmapped.  The file is not extended,
+//      so the range must lie within it.
+//
+//      Returns the virtual address of the mapping, 0 on error.
+//
+// AddrSpace::Munmap
+//      Remove the file mapping that starts at "address".
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Mmap(int fileSector, int offset, int length)
+{
+    OpenFile *file;
+    MmapRegion *region;
+    int pages = divRoundUp(length, PageSize);
+
+    if (length <= 0 || offset < 0 || offset % PageSize != 0 ||
+            numPages + pages > mmapBase + MaxMmapPages)
+        return 0;
+    file = new OpenFile(fileSector);
+    if (offset + length > file->Length()) {
+        delete file;
+        return 0;
+    }
+
+    region = AddRegion(pages);
+    region->file = file;
+    region->fileOffset = offset;
+    DEBUG('a', "Mapped %d bytes of file %d at 0x%x\n", length, fileSector,
+          region->firstVpn * PageSize);
+    return region->firstVpn * PageSize;
+}
+
+int
+AddrSpace::Munmap(int address)
+{
+    return RemoveRegion(address, FALSE);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ShmAttach
+//      Map shared memory segment "id" (see PageManager::shmCreate) above
+//      the other mappings.  Its frames are mapped right away, so it
+//      never faults.  Returns the virtual address, 0 on error.
+//
+// AddrSpace::ShmDetach
+//      Unmap the segment attached at "address"; 0, or -1 if there is
+//      none.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::ShmAttach(int id)
+{
+    MmapRegion *region;
+    int pages = pageManager->shmSize(id);
+
+    if (pages == -1 || numPages + pages > mmapBase + MaxMmapPages)
+        return 0;
+    region = AddRegion(pages);
+    region->shmId = id;
+    pageManager->shmAttach(id, this, region->firstVpn);
+    return region->firstVpn * PageSize;
+}
+
+int
+AddrSpace::ShmDetach(int address)
+{
+    return RemoveRegion(address, TRUE);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddRegion
+//      Make room for a mapping of "pages" pages at the top of the
+//      address space.
+//
+// AddrSpace::RemoveRegion
+//      Remove the mapping that starts at "address", if it is a shared
+//      memory segment as "shm" says.  The resident pages of a file are
+//      evicted, which writes the dirty ones back to the file.  If it
+//      was the topmost mapping the address space shrinks, so that the
+//      next one can use the pages again.
+//
+//      Returns 0, or -1 if there is no such mapping at "address".
+//----------------------------------------------------------------------
+
+MmapRegion *
+AddrSpace::AddRegion(int pages)
+{
+    MmapRegion *region = new MmapRegion;
+
+    region->firstVpn = numPages;
+    region->numPages = pages;
+    region->file = NULL;
+    region->fileOffset = 0;
+    region->shmId = -1;
+    region->next = regions;
+    regions = region;
+    ResizePageTable(numPages + pages);
+    return region;
+}
+
+int
+AddrSpace::RemoveRegion(int address, bool shm)
+{
+    MmapRegion **prev = &regions;
+    MmapRegion *region;
+    int top = mmapBase;
+
+    while (*prev != NULL && (*prev)->firstVpn * PageSize != address)
+        prev = &(*prev)->next;
+    if (*prev == NULL || ((*prev)->shmId != -1) != shm)
+        return -1;
+    region = *prev;
+    *prev = region->next;
+
+    if (shm) {
+        pageManager->shmDetach(region->shmId, this, region->firstVpn);
+    } else {
+        for (int vpn = region->firstVpn; vpn < region->firstVpn + region->numPages; vpn++) {
+            TranslationEntry *entry = findPageEntry(vpn);
+            if (entry == NULL)
+                continue;
+            if (entry->valid)
+                pageManager->swapPage(entry->physicalPage);
+            entry->use = FALSE;
+            entry->dirty = FALSE;
+        }
+        delete region->file;
+    }
+    delete region;
+
+    for (region = regions; region != NULL; region = region->next)
+        top = max(top, region->firstVpn + region->numPages);
+    ResizePageTable(top);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindRegion
+//      The mapping holding virtual page "vpn".
+//
+// AddrSpace::LoadFromFile, WriteToFile
+//      Read mapped page "vpn" from its file, or write it back.  The
+//      part of the last page beyond the end of the file reads as zeros
+//      and is never written.
+//----------------------------------------------------------------------
+
+MmapRegion *
+AddrSpace::FindRegion(int vpn)
+{
+    MmapRegion *region;
+
+    for (region = regions; region != NULL; region = region->next)
+        if (vpn >= region->firstVpn && vpn < region->firstVpn + region->numPages)
+            return region;
+    return NULL;
+}
+
+void
+AddrSpace::LoadFromFile(int vpn, char *into)
+{
+    MmapRegion *region = FindRegion(vpn);
+    ASSERT(region != NULL);
+
+    bzero(into, PageSize);
+    region->file->ReadAt(into, PageSize,
+                         region->fileOffset + (vpn - region->firstVpn) * PageSize);
+}
+
+void
+AddrSpace::WriteToFile(int vpn, char *from)
+{
+    MmapRegion *region = FindRegion(vpn);
+    ASSERT(region != NULL);
+    int position = region->fileOffset + (vpn - region->firstVpn) * PageSize;
+    int bytes = min(PageSize, region->file->Length() - position);
+
+    if (bytes > 0)
+        region->file->WriteAt(from, bytes, position);
+}
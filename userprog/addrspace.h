@@ -15,14 +15,55 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+#define MaxFaultAround		4	// most pages brought in around one fault
+#define MaxFaultStride		4	// farther apart faults aren't a pattern
+
+#define MaxMmapPages		256	// most pages of files one address space
+					// may have mapped at a time
+
+// What a virtual page holds, as far as the executable is concerned.
+// Decides where the page comes from the first time it is touched.
+enum PageType { CodePage,	// only code: read-only, shared (see pageManager.h)
+		DataPage,	// some initialized data (or code and data)
+		ZeroPage,	// bss or stack: starts out as zeros
+		MappedPage };	// part of a mapped file or of a shared
+				// memory segment (see Mmap, ShmAttach)
+
+// What we keep about a virtual page besides its translation.  Kept in
+// arrays parallel to the second-level page tables (see translate.h), so
+// they only exist for the parts of the address space in use.
+
+class PageInfo {
+  public:
+    int swapSlot;		// swap slot of the page, -1 if it has none
+    bool prefetched;		// brought in by fault-around, not yet seen used
+};
+
+// A range of a file mapped into an address space by Mmap.  The pages
+// are read from the file when first touched, and written back to it
+// when they are evicted dirty, or unmapped.  A shared memory segment
+// attached by ShmAttach is kept the same way, without a file.
+
+class MmapRegion {
+  public:
+    int firstVpn;		// first virtual page of the mapping
+    int numPages;
+    OpenFile *file;		// our own handle on the mapped file
+    int fileOffset;		// where firstVpn is in the file
+    int shmId;			// the shared memory segment, or -1 for a file
+    MmapRegion *next;
+};
+
 class AddrSpace {
   public:
     AddrSpace(OpenFile *executable);	// Create an address space,
 					// initializing it with the program
-					// stored in the file "executable"
+					// stored in the file "executable",
+					// which it keeps open from now on
     AddrSpace(int _tid, void* _fatherSpace);
     ~AddrSpace();			// De-allocate an address space
 
@@ -35,20 +76,60 @@ class AddrSpace {
     int AddrTrans(int address);     //from physical address to virtual address 
     int getStackReg();
     int getPageNum(){return numPages;}
+    TranslationEntry *getPageEntry(int vpn);    // translation of "vpn", allocating
+                                                // its second-level table if needed
+    TranslationEntry *findPageEntry(int vpn);   // same, but NULL if there is none
     int getAvailPageNum(){return availNumPages;}
     void setAvailPageNum(int pages){ availNumPages=pages;}
-    char *getFileName(){return filename;}
-    void setFileName(char *f){filename=f;}
-    void CreateTempFile(OpenFile *executable, char *tempfile, int filesize);
-    void SwapOut();
+    int getResidentLimit(){return residentLimit;}
+    void setResidentLimit(int pages){residentLimit=pages;}
+    int getLastFaultTime(){return lastFaultTime;}
+    void setLastFaultTime(int time){lastFaultTime=time;}
+    int getSwapSlot(int vpn);
+    void setSwapSlot(int vpn, int slot);
+    void LoadFromExecutable(int vpn, char *into, int count = 1);
+                                    // fill "count" pages from "vpn" on, that were never swapped out
+    int FaultAround(int vpn, int *stride);   // how many pages to prefetch after a fault
+    void setPrefetched(int vpn);
+    void CheckPrefetch(int vpn, bool evicting);     // count a prefetched page that was used
+    int getExecSector(){return execFile->FileSector();}
+    PageType getPageType(int vpn);
+    bool isCodePage(int vpn){return getPageType(vpn)==CodePage;}
+    void SwapOut();                 // give back all frames when suspended,
+    void SwapIn();                  // and claim them again when activated
+    int getAsid(){return asid;}
+    int Mmap(int fileSector, int offset, int length);   // map a file range, return its address
+    int Munmap(int address);        // write back and remove the mapping at "address"
+    int ShmAttach(int id);          // map shared memory segment "id", return its address
+    int ShmDetach(int address);     // unmap the segment attached at "address"
+    void LoadFromFile(int vpn, char *into);     // transfer a mapped page from/to
+    void WriteToFile(int vpn, char *from);      // its file
   private:
-    TranslationEntry *pageTable;	// Assume linear page table translation
-					// for now!
+    TranslationEntry **pageDirectory;	// Two-level page table
+    PageInfo **pageInfo;		// and the same for our own data
+    int numDirEntries;
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    void AllocPageTable(int dir);	// Second-level tables for directory
+					// entry "dir"
+    void ResizePageTable(int pages);	// Grow or shrink the address space
+					// to "pages" pages
+    MmapRegion *FindRegion(int vpn);
+    MmapRegion *AddRegion(int pages);	// Room for a mapping above the others
+    int RemoveRegion(int address, bool shm);
     //by LMX
-    char *filename;         //the file that store the whole content of a executable
-    unsigned int availNumPages;
+    NoffHeader noffH;       //segment layout of the executable
+    OpenFile *execFile;     //the executable, kept open while the program runs;
+                            //clean pages are read from it
+    int lastFault;          //fault-around state: the last page faulted on or
+    int faultStride;        //prefetched, the distance between the last two
+    int faultAround;        //faults, and how many pages to prefetch
+    int asid;               //tags our entries in the TLB
+    unsigned int mmapBase;  //first page above the stack, mappings go from there
+    MmapRegion *regions;    //the mapped files
+    int availNumPages;      //frames it may still take: residentLimit - resident pages
+    int residentLimit;      //resident set size granted by the page-fault-frequency policy
+    int lastFaultTime;      //time of the last page fault, for that policy
 };
 
 #endif // ADDRSPACE_H
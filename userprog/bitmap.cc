@@ -8,6 +8,8 @@
 
 #include "copyright.h"
 #include "bitmap.h"
+#include "disk.h"
+#include <string.h>
 
 //----------------------------------------------------------------------
 // BitMap::BitMap
@@ -111,6 +113,52 @@ BitMap::JustFind()
 	}
     return -1;
 }
+
+//----------------------------------------------------------------------
+// BitMap::FindNear
+// 	Find and allocate the first clear bit at or after "hint", going
+//	on from the start if there is none up to the end.  Used to keep
+//	the sectors of a file together.
+//
+// BitMap::FindRun
+// 	Return the first bit at or after "hint" that starts "count" clear
+//	bits in a row; else the first one before it; or -1 if there is
+//	no such run.  Nothing is allocated.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindNear(int hint)
+{
+    if (hint < 0 || hint >= numBits)
+	hint = 0;
+    for (int i = 0; i < numBits; i++) {
+	int which = (hint + i) % numBits;
+	if (!Test(which)) {
+	    Mark(which);
+	    return which;
+	}
+    }
+    return -1;
+}
+
+int
+BitMap::FindRun(int count, int hint)
+{
+    if (hint < 0 || hint >= numBits)
+	hint = 0;
+    for (int pass = 0; pass < 2; pass++) {
+	int start = (pass == 0) ? hint : 0;
+	int end = (pass == 0) ? numBits : min(hint + count - 1, numBits);
+
+	for (int i = start; i < end; i++) {
+	    if (Test(i))
+		start = i + 1;
+	    else if (i - start + 1 == count)
+		return start;
+	}
+    }
+    return -1;
+}
 //----------------------------------------------------------------------
 // BitMap::NumClear
 // 	Return the number of clear bits in the bitmap.
@@ -171,4 +219,34 @@ void
 BitMap::WriteBack(OpenFile *file)
 {
    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+}
+
+//----------------------------------------------------------------------
+// BitMap::WriteChanges
+// 	Store the contents of a bitmap to a Nachos file, where "onDisk"
+//	(a bitmap of the same size) is what the file holds now.  Only the
+//	sectors that differ are written, and "onDisk" is brought up to
+//	date.  The bits set in "except", if any, are stored clear: they
+//	are taken here, but free on disk.
+//----------------------------------------------------------------------
+
+void
+BitMap::WriteChanges(OpenFile *file, BitMap *onDisk, BitMap *except)
+{
+    int size = numWords * sizeof(unsigned);
+    unsigned int *words = new unsigned int[numWords];
+    char *now = (char *) words;
+    char *then = (char *) onDisk->map;
+
+    ASSERT(onDisk->numWords == numWords);
+    for (int i = 0; i < numWords; i++)
+        words[i] = (except == NULL) ? map[i] : map[i] & ~except->map[i];
+    for (int pos = 0; pos < size; pos += SectorSize) {
+        int bytes = min(SectorSize, size - pos);
+        if (memcmp(now + pos, then + pos, bytes) != 0) {
+            file->WriteAt(now + pos, bytes, pos);
+            bcopy(now + pos, then + pos, bytes);
+        }
+    }
+    delete [] words;
 }
\ No newline at end of file
@@ -41,6 +41,12 @@ class BitMap {
     void Clear(int which);  	// Clear the "nth" bit
     bool Test(int which);   	// Is the "nth" bit set?
     int JustFind();
+    int FindNear(int hint);	// Like Find, but the first clear bit at
+				// or after "hint", wrapping around
+    int FindRun(int count, int hint = 0);
+    				// Where "count" clear bits in a row start,
+				// first looking at or after "hint";
+				// -1 if nowhere; nothing is set
     int Find();            	// Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
@@ -52,6 +58,10 @@ class BitMap {
     // write the bitmap to a file
     void FetchFrom(OpenFile *file); 	// fetch contents from disk 
     void WriteBack(OpenFile *file); 	// write contents to disk
+    void WriteChanges(OpenFile *file, BitMap *onDisk,
+    		BitMap *except = NULL);	// write only the sectors that
+					// differ from "onDisk", with the
+					// bits set in "except" clear
 
     //by LMX
     float ShowUsage();
@@ -67,6 +67,223 @@ getStringFromMem(int baseAddr, char *name)
     }
 }
 
+#define UserMemTries	3	// a page fault, then the access succeeds
+
+//----------------------------------------------------------------------
+// WriteUserMem
+// 	Store into user memory on behalf of a system call.  The page may
+//	not be mapped yet, or be shared copy-on-write after a fork: the
+//	exception handler fixes the mapping and we try again.  An address
+//	the program can't write (read-only, or not in its address space)
+//	fails every time: then return FALSE.
+//----------------------------------------------------------------------
+
+static bool
+WriteUserMem(int addr, int size, int value)
+{
+    for (int i = 0; i < UserMemTries; i++)
+        if (machine->WriteMem(addr, size, value))
+            return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// ReadUserMem
+// 	Load from user memory on behalf of a system call, trying again
+//	after the exception handler has brought the page in.  An address
+//	the program can't read fails every time: then return FALSE.
+//----------------------------------------------------------------------
+
+static bool
+ReadUserMem(int addr, int size, int *value)
+{
+    for (int i = 0; i < UserMemTries; i++)
+        if (machine->ReadMem(addr, size, value))
+            return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SysCreate/SysOpen/SysClose/SysWrite/SysRead
+// 	The file system calls.  They are shared by the trap path in
+//	ExceptionHandler and by the batched ring (SysEnter), so they take
+//	their arguments explicitly and return the value for r2.
+//
+//	An OpenFileId is the header sector of the file, and every call
+//	opens the file anew, at position 0, and closes it.  So the append
+//	buffer of OpenFile does not carry over from one Write to the next:
+//	a Write past the end grows the file once, on its own.  Keeping the
+//	OpenFile until Close would also hide the appended bytes from other
+//	processes reading the file (shmbench talks through files this way).
+//	Only kernel writers that keep a file open, like Copy (-cp) and the
+//	performance test, get many appends per allocation.
+//----------------------------------------------------------------------
+
+static int
+SysCreate(int baseAddr)
+{
+    char name[FileNameMaxLen+1];
+    getStringFromMem(baseAddr,name);
+    bool create_res=fileSystem->Create(name,0);
+    if(!create_res){
+        printf("Create file failed.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+SysOpen(int baseAddr)
+{
+    char name[FileNameMaxLen+1];
+    getStringFromMem(baseAddr,name);
+
+    OpenFile* file = fileSystem->Open(name);
+    if (file == NULL)
+        return -1;
+    OpenFileId fid = file->GetFileDescriptor();
+    printf("OpenFileId is %d\n", fid);
+    delete file;
+    return fid;
+}
+
+static int
+SysClose(int fd)
+{
+    OpenFile* file = new OpenFile(fd);
+    delete file;
+    return 0;
+}
+
+static int
+SysWrite(int baseAddr, int size, int fd)
+{
+    int realSize = size;
+    char* buffer = new char[size];
+    int i = 0;
+    while(i < size) {
+        machine->ReadMem(baseAddr + i, 1,(int *)&buffer[i]);
+        i++;
+    }
+    if (fd==ConsoleOutput){
+        for(int i=0;i<size;i++)
+            printf("%c",buffer[i]);
+    }else{
+        OpenFile* file = new OpenFile(fd);
+        realSize = file->Write(buffer,size);
+        if(realSize != size) {
+            printf("Only wrote %d bytes of size %d.\n",realSize,size);
+        }
+        delete file;
+    }
+    delete [] buffer;
+    return realSize;
+}
+
+static int
+SysRead(int baseAddr, int size, int fd)
+{
+    DEBUG('a', "Read a file.\n");
+    char* buffer = new char[size];
+    int realSize = 0;
+
+    if (fd==ConsoleInput){
+        for(int i=0;i<size;i++)
+            scanf("%c",&buffer[i]);
+        realSize = size;
+    }else{
+        OpenFile* file = new OpenFile(fd);
+        realSize = file->Read(buffer,size);
+        if(realSize != size) {
+            printf("Exception: Only read %d bytes of size %d.\n",realSize,size);
+        }
+        delete file;
+    }
+    for (int i = 0; i < realSize; i++)
+        if (!WriteUserMem(baseAddr + i, 1, (int)buffer[i])) {
+            realSize = -1;		// not the program's buffer
+            break;
+        }
+    delete [] buffer;
+    return realSize;
+}
+
+//----------------------------------------------------------------------
+// SysEnter
+// 	Drain a batched system call ring (see syscall.h).  The ring lives
+//	in user memory at "ringAddr"; every entry between head and tail is
+//	dispatched to the same routine the direct trap would use, and its
+//	return value is stored back into the entry.  One trap thus pays
+//	for a whole batch of file operations.
+//
+//	head and tail come from the program, so a ring claiming more than
+//	RingSize entries, or a negative head, is refused.  If an entry
+//	can't be read, the drain stops there; if its result can't be
+//	stored, just after it.
+//
+//	Returns the number of entries consumed, -1 for a bad ring.
+//----------------------------------------------------------------------
+
+#define RingHeadAddr(ring)	(ring)
+#define RingTailAddr(ring)	((ring) + sizeof(int))
+#define RingEntryAddr(ring, i)	((ring) + 2 * sizeof(int) + \
+					((i) % RingSize) * sizeof(RingEntry))
+
+static int
+SysEnter(int ringAddr)
+{
+    int head, tail, done = 0;
+
+    if (!ReadUserMem(RingHeadAddr(ringAddr), 4, &head) ||
+            !ReadUserMem(RingTailAddr(ringAddr), 4, &tail))
+        return -1;
+    DEBUG('a', "Enter ring at 0x%x, head %d, tail %d\n", ringAddr, head, tail);
+    if (head < 0 || tail < head || tail - head > RingSize) {
+        printf("Enter: bad ring, head %d, tail %d\n", head, tail);
+        return -1;
+    }
+
+    for (; head != tail; head++, done++) {
+        int entry = RingEntryAddr(ringAddr, head);
+        int op, arg1, arg2, arg3, result;
+
+        if (!ReadUserMem(entry, 4, &op) ||
+                !ReadUserMem(entry + sizeof(int), 4, &arg1) ||
+                !ReadUserMem(entry + 2 * sizeof(int), 4, &arg2) ||
+                !ReadUserMem(entry + 3 * sizeof(int), 4, &arg3))
+            break;			// not dispatched, head stays on it
+        switch (op) {
+          case SC_Create:
+            result = SysCreate(arg1);
+            break;
+          case SC_Open:
+            result = SysOpen(arg1);
+            break;
+          case SC_Read:
+            result = SysRead(arg1, arg2, arg3);
+            break;
+          case SC_Write:
+            result = SysWrite(arg1, arg2, arg3);
+            break;
+          case SC_Close:
+            result = SysClose(arg1);
+            break;
+          default:
+            printf("Enter: unsupported operation %d in ring\n", op);
+            result = -1;
+            break;
+        }
+        if (!WriteUserMem(entry + 4 * sizeof(int), 4, result)) {
+            head++;			// dispatched: not again
+            done++;
+            break;
+        }
+    }
+    if (!WriteUserMem(RingHeadAddr(ringAddr), 4, head))
+        return -1;
+    return done;
+}
+
 void threadExec(int arg)
 {
     printf("In thread exec\n");
@@ -92,77 +309,33 @@ ExceptionHandler(ExceptionType which)
 	DEBUG('a', "Shutdown, initiated by user program.\n");
    	interrupt->Halt();
     }else if((which == SyscallException) && (type == SC_Create)){
-        int baseAddr = machine->ReadRegister(4);
-        char name[FileNameMaxLen+1];
-        getStringFromMem(baseAddr,name);
-        bool create_res=fileSystem->Create(name,0);
-        if(!create_res)
-		printf("Create file failed.\n");
+        SysCreate(machine->ReadRegister(4));
     }else if((which == SyscallException) && (type == SC_Open)){
-       int baseAddr = machine->ReadRegister(4);
-	char name[FileNameMaxLen+1];
-       getStringFromMem(baseAddr,name);
-       
-	OpenFile* file = fileSystem->Open(name);
-	OpenFileId fid = file->GetFileDescriptor();
-       printf("OpenFileId is %d\n", fid);
-       machine->WriteRegister(2,fid);
-
-       //fileManager->Append(file->FileSector());
+        machine->WriteRegister(2, SysOpen(machine->ReadRegister(4)));
     }else if((which == SyscallException) && (type == SC_Close)){
-       int fd = machine->ReadRegister(4);
-	OpenFile* file = new OpenFile(fd);
-	//fileManager->Remove(file->FileSector());
-       delete file;
+        SysClose(machine->ReadRegister(4));
     }else if ((which == SyscallException) && (type == SC_Write)) {
-	int fd = machine->ReadRegister(6);
-	int size = machine->ReadRegister(5);
-	int baseAddr = machine->ReadRegister(4);
-
-	char* buffer = new char[size];
-	int i = 0;
-	while(i < size) {
-		machine->ReadMem(baseAddr + i, 1,(int *)&buffer[i]);
-		i++;
-	}
-       if (fd==ConsoleOutput){
-            for(int i=0;i<size;i++)
-                printf("%c",buffer[i]);
-       }else{
-	    OpenFile* file = new OpenFile(fd);
-	    int realSize = file->Write(buffer,size);
-	    if(realSize != size) {
-		    printf("Only wrote %d bytes of size.\n",realSize,size);
-	    }
-        }
-	delete buffer;
+        SysWrite(machine->ReadRegister(4), machine->ReadRegister(5),
+                 machine->ReadRegister(6));
     } else if ((which == SyscallException) && (type == SC_Read)) {
-	DEBUG('a', "Read a file.\n");
-	int fd = machine->ReadRegister(6);
-	int size = machine->ReadRegister(5);
-	int baseAddr = machine->ReadRegister(4);
-	char* buffer = new char[size];
-       int realSize = 0;
-       
-       if (fd==ConsoleInput){
-            for(int i=0;i<size;i++)
-                scanf("%c",&buffer[i]);
-            realSize = size;
-       }else{
-	    OpenFile* file = new OpenFile(fd);
-	    realSize = file->Read(buffer,size);
-    	    if(realSize != size) {
-		printf("Exception: Only wrote %d bytes of size.\n",realSize,size);
-	    }
-       }
-       int i = 0;
-	while(i < size) {
-		machine->WriteMem(baseAddr + i, 1,(int)buffer);
-		i++;
-	}
-       printf("Read: %s\n",buffer);
-       machine->WriteRegister(2, realSize);
-	delete buffer;
+        int realSize = SysRead(machine->ReadRegister(4), machine->ReadRegister(5),
+                               machine->ReadRegister(6));
+        machine->WriteRegister(2, realSize);
+    }else if ((which == SyscallException) && (type == SC_Enter)) {
+        machine->WriteRegister(2, SysEnter(machine->ReadRegister(4)));
+    }else if ((which == SyscallException) && (type == SC_Mmap)) {
+        machine->WriteRegister(2, currentThread->space->Mmap(machine->ReadRegister(4),
+                               machine->ReadRegister(5), machine->ReadRegister(6)));
+    }else if ((which == SyscallException) && (type == SC_Munmap)) {
+        machine->WriteRegister(2, currentThread->space->Munmap(machine->ReadRegister(4)));
+    }else if ((which == SyscallException) && (type == SC_ShmCreate)) {
+        machine->WriteRegister(2, pageManager->shmCreate(machine->ReadRegister(4),
+                                                         machine->ReadRegister(5),
+                                                         currentThread->space));
+    }else if ((which == SyscallException) && (type == SC_ShmAttach)) {
+        machine->WriteRegister(2, currentThread->space->ShmAttach(machine->ReadRegister(4)));
+    }else if ((which == SyscallException) && (type == SC_ShmDetach)) {
+        machine->WriteRegister(2, currentThread->space->ShmDetach(machine->ReadRegister(4)));
     }else if ((which == SyscallException) && (type == SC_Exec)) {
        int baseAddr = machine->ReadRegister(4);
 	char name[FileNameMaxLen+1];
@@ -178,19 +351,9 @@ ExceptionHandler(ExceptionType which)
        Thread * t = new Thread("ExecThread");
        
        AddrSpace * space = new AddrSpace(executable); 
-       char *tempfile=new char[FileNameMaxLen+1];
-       char tid[3];
-       sprintf(tid,"%d",t->getTID());
-       int filesize = (space ->getPageNum()) * PageSize ;
-       strcpy(tempfile,name);
-       strcat(tempfile,tid);
-       //printf("name:%s\n",tempfile);
-        space->CreateTempFile(executable, tempfile, filesize);
 
        t->space = space;
-       t->space->setFileName(tempfile);
        t->InitUserReg();
-       delete executable;
        machine->WriteRegister(2, t->getTID());
        t->Fork(threadExec,0);
     }else if ((which == SyscallException) && (type == SC_Fork)) {
@@ -250,6 +413,9 @@ ExceptionHandler(ExceptionType which)
         (stats->numPageFaults) ++;
         int address=machine->registers[BadVAddrReg];
         pageManager->loadPage(address);
+    }else if(which==ReadOnlyException){
+        int address=machine->registers[BadVAddrReg];
+        pageManager->copyOnWrite(address);
     }else {
 	printf("Unexpected user mode exception %d %d\n", which, type);
        ASSERT(FALSE);
@@ -3,161 +3,798 @@
 #include "system.h"
 #include "addrspace.h"
 
+//----------------------------------------------------------------------
+// FlushTLB
+//      Forget the TLB translation of virtual page "vpn" of "space", whose
+//      page table entry just changed.  The TLB may hold translations of
+//      any address space, told apart by their ASID.
+//----------------------------------------------------------------------
+
+static void
+FlushTLB(AddrSpace *space, int vpn)
+{
+    if (machine->tlb != NULL)
+        machine->InvalidateTLB(vpn, space->getAsid());
+}
+
 PageManager::PageManager()
 {
-    manager = new BitMap(MemorySize);
+    frameTable = new FrameEntry[NumPhysPages];
+    freeFrames = new int[NumPhysPages];
+    numFree = 0;
+    for (int i = NumPhysPages - 1; i >= 0; i--) {
+        frameTable[i].mappings = NULL;
+        frameTable[i].numMappings = 0;
+        frameTable[i].dirty = FALSE;
+        frameTable[i].pinCount = 0;
+        frameTable[i].execSector = -1;
+        frameTable[i].textVpn = -1;
+        frameTable[i].textNext = -1;
+        frameTable[i].shmSegment = -1;
+        freeFrames[numFree++] = i;     // hand out low pages first
+    }
+    for (int i = 0; i < TextHashSize; i++)
+        textHash[i] = -1;
+    hand = 0;
+    committed = 0;
+    for (int i = 0; i < MaxShmSegments; i++)
+        shmTable[i].key = -1;
+    shmUsed = 0;
+    ASSERT(PageSize == SectorSize);
+    swapMap = new BitMap(SwapSectors);
+    swapRefs = new int[SwapSectors];
+    for (int i = 0; i < SwapSectors; i++)
+        swapRefs[i] = 0;
 }
 
 PageManager::~PageManager()
 {
-    delete manager;
+    delete [] frameTable;
+    delete [] freeFrames;
+    delete swapMap;
+    delete [] swapRefs;
 }
 
-//find a clean page
+//find a clean page and take it off the free list
 int 
 PageManager::findPage()
 {
-    int address = manager ->JustFind();  
-
-     if( address == -1 )      
+    if (numFree == 0)
         return -1;
-     return address / PageSize;
+    return freeFrames[--numFree];
 }
 
 // return the number of clean pages
 int 
 PageManager::numClean()
 {
-    int num = manager ->NumClear();   // return how many bytes are clean
-    ASSERT(num % PageSize == 0);   // the number must be a multiple of PageSize 
-    return num / PageSize;         
+    return numFree;
 }
 
-//mark these pages as allocated
+//map a virtual page of an address space to the page
 void
-PageManager::markPage(int pagenum)
+PageManager::markPage(int pagenum, AddrSpace *space, int vpn)
 {
-    int address = pagenum * PageSize; 
-    for(int i = address; i < address + PageSize; i++)
-         manager ->Mark(i);     
+    ASSERT(pagenum >= 0 && pagenum < NumPhysPages);
+    FrameMapping *map = new FrameMapping;
+    map->space = space;
+    map->vpn = vpn;
+    map->entry = space->getPageEntry(vpn);
+    map->next = frameTable[pagenum].mappings;
+    frameTable[pagenum].mappings = map;
+    frameTable[pagenum].numMappings++;
 }
 
-//mark these pages as free            
+//drop the mapping of one address space, the last one frees the page
+//(unless it belongs to a shared memory segment, which frees it itself)
+void
+PageManager::unmapPage(int pagenum, AddrSpace *space)
+{
+    FrameEntry *frame = &frameTable[pagenum];
+    FrameMapping **prev = &frame->mappings;
+    while (*prev != NULL && (*prev)->space != space)
+        prev = &(*prev)->next;
+    ASSERT(*prev != NULL);
+    FrameMapping *map = *prev;
+    *prev = map->next;
+    delete map;
+    frame->numMappings--;
+    if (frame->numMappings == 0 && frame->shmSegment == -1)
+        cleanPage(pagenum);
+}
+
+bool
+PageManager::mapsPage(int pagenum, AddrSpace *space)
+{
+    for (FrameMapping *map = frameTable[pagenum].mappings; map != NULL; map = map->next)
+        if (map->space == space)
+            return TRUE;
+    return FALSE;
+}
+
+//put the page back on the free list
 void 
 PageManager::cleanPage(int pagenum)
 {
-    int address = pagenum * PageSize;
-    for(int i = address; i < address + PageSize; i++)
-         manager ->Clear(i);     
+    ASSERT(pagenum >= 0 && pagenum < NumPhysPages);
+    ASSERT(numFree < NumPhysPages);
+    FrameEntry *frame = &frameTable[pagenum];
+    while (frame->mappings != NULL) {
+        FrameMapping *map = frame->mappings;
+        frame->mappings = map->next;
+        delete map;
+    }
+    frame->numMappings = 0;
+    frame->dirty = FALSE;
+    frame->pinCount = 0;
+    frame->shmSegment = -1;
+    if (frame->execSector != -1)
+        removeTextPage(pagenum);
+    freeFrames[numFree++] = pagenum;
+}
+
+//----------------------------------------------------------------------
+// PageManager::findTextPage, addTextPage, removeTextPage
+//      The text cache.  A page that lies entirely in the code segment
+//      of an executable is the same for every process running it, so
+//      one read-only copy is mapped by all of them.  The cache is a
+//      hash table on (header sector of the executable, vpn), chained
+//      through the frame table; a frame leaves it when it is freed.
+//----------------------------------------------------------------------
+
+static int
+TextHash(int execSector, int vpn)
+{
+    return (unsigned) (execSector * 31 + vpn) % TextHashSize;
+}
+
+int
+PageManager::findTextPage(int execSector, int vpn)
+{
+    for (int i = textHash[TextHash(execSector, vpn)]; i != -1; i = frameTable[i].textNext)
+        if (frameTable[i].execSector == execSector && frameTable[i].textVpn == vpn)
+            return i;
+    return -1;
+}
+
+void
+PageManager::addTextPage(int pagenum, int execSector, int vpn)
+{
+    int bucket = TextHash(execSector, vpn);
+    frameTable[pagenum].execSector = execSector;
+    frameTable[pagenum].textVpn = vpn;
+    frameTable[pagenum].textNext = textHash[bucket];
+    textHash[bucket] = pagenum;
+}
+
+void
+PageManager::removeTextPage(int pagenum)
+{
+    FrameEntry *frame = &frameTable[pagenum];
+    int *prev = &textHash[TextHash(frame->execSector, frame->textVpn)];
+    while (*prev != pagenum) {
+        ASSERT(*prev != -1);
+        prev = &frameTable[*prev].textNext;
+    }
+    *prev = frame->textNext;
+    frame->execSector = -1;
+    frame->textVpn = -1;
+    frame->textNext = -1;
+}
+
+void
+PageManager::pinPage(int pagenum)
+{
+    frameTable[pagenum].pinCount++;
+}
+
+void
+PageManager::unpinPage(int pagenum)
+{
+    ASSERT(frameTable[pagenum].pinCount > 0);
+    frameTable[pagenum].pinCount--;
+}
+
+//----------------------------------------------------------------------
+// PageManager::reserveFrames, releaseFrames
+//      Keep track of the memory demand, the sum of the resident set
+//      limits of the processes that may run.  Once enough is released
+//      for the first suspended process to get its resident set limit
+//      back, it is activated again.
+//----------------------------------------------------------------------
+
+void
+PageManager::reserveFrames(int count)
+{
+    committed += count;
+}
+
+void
+PageManager::releaseFrames(int count)
+{
+    committed -= count;
+    ASSERT(committed >= 0);
+    if (!scheduler->getSuspendList()->IsEmpty()) {
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+        scheduler->ActiveOne(NumPhysPages - committed);
+        (void) interrupt->SetLevel(oldLevel);
+    }
+}
+
+//----------------------------------------------------------------------
+// PageManager::adjustResidentSet
+//      Page-fault-frequency policy, run on each page fault of "space".
+//      Frequent faults mean the resident set is too small: grow it by
+//      a frame, suspending another process first if memory is fully
+//      committed (if there is nobody to suspend we grow anyway, and the
+//      clock takes frames from whoever uses them least).  Rare faults
+//      mean it is bigger than the working set: shrink it by a frame,
+//      evicting one of its pages if it has no frame to spare.
+//----------------------------------------------------------------------
+
+void
+PageManager::adjustResidentSet(AddrSpace *space)
+{
+    int now = stats->totalTicks;
+    int interval = now - space->getLastFaultTime();
+    space->setLastFaultTime(now);
+
+    if (interval < PFFLowInterval && space->getResidentLimit() < NumPhysPages) {
+        if (committed >= NumPhysPages) {
+            IntStatus oldLevel = interrupt->SetLevel(IntOff);
+            scheduler->SuspendOne();
+            (void) interrupt->SetLevel(oldLevel);
+        }
+        space->setResidentLimit(space->getResidentLimit()+1);
+        space->setAvailPageNum(space->getAvailPageNum()+1);
+        committed++;
+        DEBUG('a', "%s faults often, resident set now %d\n",
+              currentThread->getName(), space->getResidentLimit());
+    } else if (interval > PFFHighInterval && space->getResidentLimit() > MinResident) {
+        if (space->getAvailPageNum() == 0) {
+            int victim = getSwapPageClock(space);
+            if (victim == -1)
+                return;
+            swapPage(victim);
+        }
+        space->setResidentLimit(space->getResidentLimit()-1);
+        space->setAvailPageNum(space->getAvailPageNum()-1);
+        DEBUG('a', "%s faults rarely, resident set now %d\n",
+              currentThread->getName(), space->getResidentLimit());
+        releaseFrames(1);
+    }
+}
+
+//----------------------------------------------------------------------
+// PageManager::allocSwapSlot, freeSwapSlot, readSwap, writeSwap
+//      The swap area is the range of sectors the file system leaves
+//      alone at the end of the disk (see filesys.h); slot i is sector
+//      SwapStartSector + i and holds exactly one page.
+
+//      A slot may be shared by several address spaces after a fork;
+//      "swapRefs" counts its users.
+//----------------------------------------------------------------------
+
+int
+PageManager::allocSwapSlot()
+{
+    int slot = swapMap->Find();
+    ASSERT(slot != -1);     // out of swap space
+    swapRefs[slot] = 1;
+    return slot;
+}
+
+void
+PageManager::shareSwapSlot(int slot)
+{
+    ASSERT(swapRefs[slot] > 0);
+    swapRefs[slot]++;
+}
+
+void
+PageManager::freeSwapSlot(int slot)
+{
+    ASSERT(swapRefs[slot] > 0);
+    if (--swapRefs[slot] == 0)
+        swapMap->Clear(slot);
+}
+
+void
+PageManager::readSwap(int slot, char *into)
+{
+    ASSERT(slot >= 0 && slot < SwapSectors);
+    synchDisk->ReadSector(SwapStartSector + slot, into);
+}
+
+void
+PageManager::writeSwap(int slot, char *from)
+{
+    ASSERT(slot >= 0 && slot < SwapSectors);
+    synchDisk->WriteSector(SwapStartSector + slot, from);
+}
+
+bool
+PageManager::isReferenced(int pagenum)
+{
+    for (FrameMapping *map = frameTable[pagenum].mappings; map != NULL; map = map->next)
+        if (map->entry->use)
+            return TRUE;
+    return FALSE;
+}
+
+bool
+PageManager::isDirty(int pagenum)
+{
+    if (frameTable[pagenum].dirty)
+        return TRUE;
+    for (FrameMapping *map = frameTable[pagenum].mappings; map != NULL; map = map->next)
+        if (map->entry->dirty)
+            return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// PageManager::shareAll
+//      Fork without copying: every resident page of "father" is mapped
+//      read-only into "child" as well, and the father loses write
+//      access too.  The first write on either side raises a
+//      ReadOnlyException and gets a private copy (see copyOnWrite).
+//      A page that was dirty stays dirty in the frame, since nothing
+//      on disk holds its contents.
+//----------------------------------------------------------------------
+
+void
+PageManager::shareAll(AddrSpace *father, AddrSpace *child)
+{
+    for (int vpn = 0; vpn < child->getPageNum(); vpn++) {
+        TranslationEntry *entry = father->findPageEntry(vpn);
+        if (entry == NULL || entry->valid == FALSE)
+            continue;
+        int pagenum = entry->physicalPage;
+        if (entry->dirty) {
+            frameTable[pagenum].dirty = TRUE;
+            entry->dirty = FALSE;
+        }
+        entry->readOnly = TRUE;
+        FlushTLB(father, vpn);
+
+        TranslationEntry *childEntry = child->getPageEntry(vpn);
+        *childEntry = *entry;
+        childEntry->use = FALSE;
+        markPage(pagenum, child, vpn);
+        child->setAvailPageNum(child->getAvailPageNum()-1);
+    }
 }
 
 void 
 PageManager::loadPage(int address)
 {      
-     char *filename = currentThread ->space->getFileName();      // get the executable file name of the thread
-     int phynum, entryid;
+     AddrSpace *space = currentThread->space;
+     int phynum;
      int vpn = address/ PageSize;
 
      //printf("PageFault from virtual page %d!\n", vpn);
+
+     adjustResidentSet(space);
     
-     // find a clean page in the memory for the program     
-     int availPage=currentThread->space->getAvailPageNum();
+     // a code page may already be in memory for another process
+     // running the same executable; then we just map it
+     int availPage = space->getAvailPageNum();
      ASSERT(availPage>=0);
-     if(availPage==0 || numClean()==0) {
-         //entryid= getSwapPageFIFO();  
-         entryid = getSwapPageLRU();  
-         ASSERT(entryid != -1 );
-         ASSERT(machine->pageTable[entryid].valid==TRUE);
-         char *filename=currentThread->space->getFileName();
-         phynum = swapPage(entryid,filename);
-         ASSERT(phynum!=-1);
-     }else{
+     bool text = space->isCodePage(vpn);
+     int shared = text ? findTextPage(space->getExecSector(), vpn) : -1;
+     if (shared != -1) {
+         pinPage(shared);     // keep it while we make room in our quota
+         if (availPage == 0) {
+             int victim = getSwapPageClock(space);
+             ASSERT(victim != -1);
+             swapPage(victim);
+         }
+         phynum = shared;
+         space->setAvailPageNum(space->getAvailPageNum()-1);
+         markPage(phynum, space, vpn);
+     } else {
+         // find a clean page in the memory for the program; once the thread
+         // has used up its quota we replace one of its own pages, otherwise
+         // we may take a page from anybody
+         if(availPage==0 || numClean()==0) {
+             int victim = getSwapPageClock(availPage == 0 ? space : NULL);
+             ASSERT(victim != -1);
+             swapPage(victim);
+         }
          phynum = findPage();
-         currentThread->space->setAvailPageNum(availPage-1);
          ASSERT(phynum!= -1);
-     }
+         space->setAvailPageNum(space->getAvailPageNum()-1);
      
-     markPage(phynum);     //set the page 
-     //printf("virtual page: %d, physical page: %d\n", vpn, phynum); 
+         markPage(phynum, space, vpn);     //set the page 
+         pinPage(phynum);      // nobody may take it while we are reading it in
+         //printf("virtual page: %d, physical page: %d\n", vpn, phynum); 
 
-     //printf("Load virtual page %d to physical page %d from %s\n", vpn, phynum, filename);
+         //printf("Load virtual page %d to physical page %d\n", vpn, phynum);
      
-     //open file and load the page
-     OpenFile *executable = fileSystem -> Open(filename);
-     executable ->ReadAt(&(machine ->mainMemory[phynum * PageSize]), PageSize, vpn * PageSize);
+         //a page that has been swapped out comes back from its swap slot,
+         //a mapped page from its file, any other page from the executable;
+         //bss and stack pages are only zero-filled, with no disk I/O
+         int slot = space->getSwapSlot(vpn);
+         if (slot != -1)
+             readSwap(slot, &(machine->mainMemory[phynum * PageSize]));
+         else if (space->getPageType(vpn) == MappedPage)
+             space->LoadFromFile(vpn, &(machine->mainMemory[phynum * PageSize]));
+         else
+             space->LoadFromExecutable(vpn, &(machine->mainMemory[phynum * PageSize]));
+
+         // somebody may have brought in the same code page while we were
+         // reading it; then ours stays out of the cache
+         if (text && findTextPage(space->getExecSector(), vpn) == -1)
+             addTextPage(phynum, space->getExecSector(), vpn);
+     }
 
      // set the pagetable
-     machine ->pageTable[vpn].valid = TRUE;
-     machine ->pageTable[vpn].physicalPage = phynum;
-     machine ->pageTable[vpn].virtualPage = vpn;
-     machine ->pageTable[vpn].use = FALSE;
-     machine ->pageTable[vpn].dirty = FALSE;
-     machine ->pageTable[vpn].readOnly = FALSE;
+     TranslationEntry *entry = space->getPageEntry(vpn);
+     entry->valid = TRUE;
+     entry->physicalPage = phynum;
+     entry->virtualPage = vpn;
+     entry->use = FALSE;
+     entry->dirty = FALSE;
+     entry->readOnly = text;      // code is never written
 
-     machine->pageTable[vpn].comingTime=stats->totalTicks;
+     entry->comingTime=stats->totalTicks;
 
      //DumpState();
-     delete executable;
+     unpinPage(phynum);
+
+     int stride;
+     int count = space->FaultAround(vpn, &stride);
+     if (count > 0)
+         prefetchPages(space, vpn, stride, count);
 }
 
+//----------------------------------------------------------------------
+// PageManager::prefetchPages
+//      Fault-around.  Bring in up to "count" pages of "space" after
+//      "vpn", "stride" pages apart, that would come from the executable
+//      (or be zero-filled).  Only free frames within the quota of
+//      "space" are used, nothing is evicted for a guess, and a page that
+//      is resident, swapped out, or a code page already in the text
+//      cache ends the run.  With a stride of one page the run is read
+//      with a single I/O.
+//----------------------------------------------------------------------
 
-int
-PageManager::swapPage(int entryid, char *filename)
+void
+PageManager::prefetchPages(AddrSpace *space, int vpn, int stride, int count)
 {
-     ASSERT(machine->pageTable[entryid].valid==TRUE);
-     int phynum, vpn;
-     vpn=machine->pageTable[entryid].virtualPage;
-     phynum=machine->pageTable[entryid].physicalPage;
+     int pages[MaxFaultAround];
+     char buffer[MaxFaultAround * PageSize];
+     int n = 0, i;
+
+     count = min(count, min(space->getAvailPageNum(), numClean()));
+     for (i = 1; i <= count; i++) {
+         int v = vpn + i * stride;
+         if (v < 0 || v >= space->getPageNum() || (space->findPageEntry(v) != NULL && space->findPageEntry(v)->valid) ||
+                 space->getSwapSlot(v) != -1 || space->getPageType(v) == MappedPage ||
+                 (space->isCodePage(v) && findTextPage(space->getExecSector(), v) != -1))
+             break;
+         pages[n] = findPage();
+         ASSERT(pages[n] != -1);
+         space->setAvailPageNum(space->getAvailPageNum()-1);
+         markPage(pages[n], space, v);
+         pinPage(pages[n]);
+         n++;
+     }
+     if (n == 0)
+         return;
+
+     if (stride == 1 || stride == -1) {
+         int first = (stride == 1) ? vpn + 1 : vpn - n;
+         space->LoadFromExecutable(first, buffer, n);
+         for (i = 0; i < n; i++) {
+             int v = vpn + (i + 1) * stride;
+             bcopy(&buffer[(v - first) * PageSize],
+                   &(machine->mainMemory[pages[i] * PageSize]), PageSize);
+         }
+     } else {
+         for (i = 0; i < n; i++)
+             space->LoadFromExecutable(vpn + (i + 1) * stride,
+                                       &(machine->mainMemory[pages[i] * PageSize]));
+     }
+
+     for (i = 0; i < n; i++) {
+         int v = vpn + (i + 1) * stride;
+         TranslationEntry *entry = space->getPageEntry(v);
+         bool text = space->isCodePage(v);
+         if (text && findTextPage(space->getExecSector(), v) == -1)
+             addTextPage(pages[i], space->getExecSector(), v);
+         entry->valid = TRUE;
+         entry->physicalPage = pages[i];
+         entry->virtualPage = v;
+         entry->use = FALSE;
+         entry->dirty = FALSE;
+         entry->readOnly = text;
+         entry->comingTime = stats->totalTicks;
+         space->setPrefetched(v);
+         unpinPage(pages[i]);
+     }
+     stats->numPrefetches += n;
+}
+
+//----------------------------------------------------------------------
+// PageManager::copyOnWrite
+//      The current thread wrote to a page it shares copy-on-write.  If
+//      somebody else still maps the frame, copy it into a frame of our
+//      own; if we are the last one, the frame simply becomes writable.
+//      The faulting instruction is then restarted.
+//----------------------------------------------------------------------
+
+void
+PageManager::copyOnWrite(int address)
+{
+     AddrSpace *space = currentThread->space;
+     int vpn = address / PageSize;
+     TranslationEntry *entry = space->getPageEntry(vpn);
+     int oldpage = entry->physicalPage;
+     ASSERT(entry->valid == TRUE && entry->readOnly == TRUE);
+
+     if (space->isCodePage(vpn)) {
+         printf("Write to code page %d by %s\n", vpn, currentThread->getName());
+         ASSERT(FALSE);
+     }
+
+     if (frameTable[oldpage].numMappings > 1) {
+         pinPage(oldpage);     // don't pick it as the victim below
+         if (numClean() == 0) {
+             int victim = getSwapPageClock(NULL);
+             ASSERT(victim != -1);
+             swapPage(victim);
+         }
+         int phynum = findPage();
+         ASSERT(phynum != -1);
+         bcopy(&(machine->mainMemory[oldpage * PageSize]),
+               &(machine->mainMemory[phynum * PageSize]), PageSize);
+         unpinPage(oldpage);
+         // our page is no longer shared, and it is about to be modified
+         unmapPage(oldpage, space);
+         markPage(phynum, space, vpn);
+         entry->physicalPage = phynum;
+         entry->dirty = TRUE;
+     } else if (frameTable[oldpage].dirty) {
+         entry->dirty = TRUE;
+         frameTable[oldpage].dirty = FALSE;
+     }
+     entry->readOnly = FALSE;
+     FlushTLB(space, vpn);
+}
+
+//----------------------------------------------------------------------
+// PageManager::swapPage
+//      Evict the page held in physical page "pagenum": write it to the
+//      swap slot of its owners if it is dirty (a clean
+//      page still matches its slot or the executable), or back to its
+//      file if it is part of a mapped file, invalidate the
+//      translations of everybody mapping it and free the frame.  The
+//      owners get the frame back in their quota.
+//----------------------------------------------------------------------
+
+void
+PageManager::swapPage(int pagenum)
+{
+     FrameEntry *frame = &frameTable[pagenum];
+     FrameMapping *map;
+     ASSERT(frame->mappings != NULL && frame->pinCount == 0);
     
-     //printf("Page %d will be swapped out!\n",phynum);
+     //printf("Page %d will be swapped out!\n",pagenum);
 
-     machine ->pageTable[entryid].valid = FALSE;
+     for (map = frame->mappings; map != NULL; map = map->next) {
+         ASSERT(map->entry->valid==TRUE && map->entry->physicalPage==pagenum);
+         map->space->CheckPrefetch(map->vpn, TRUE);
+         map->entry->valid = FALSE;
+         FlushTLB(map->space, map->vpn);
+     }
      
-     //open file and write memory data, if the page is dirty
-     if(machine ->pageTable[entryid].dirty == TRUE)
+     //write memory data to the swap area, if the page is dirty; every
+     //mapping shares the slot.  A slot that some other page still uses
+     //holds old contents and must not be overwritten.
+     map = frame->mappings;
+     if(isDirty(pagenum) && map->space->getPageType(map->vpn) == MappedPage)
      {
+         ASSERT(frame->numMappings == 1);    // mappings are not inherited
+         pinPage(pagenum);
+         map->space->WriteToFile(map->vpn, &(machine->mainMemory[pagenum * PageSize]));
+         unpinPage(pagenum);
+     }
+     else if(isDirty(pagenum))
+     {
+         int slot = frame->mappings->space->getSwapSlot(frame->mappings->vpn);
+         if (frame->numMappings > 1 || slot == -1 || swapRefs[slot] > 1) {
+             slot = allocSwapSlot();
+             for (map = frame->mappings; map != NULL; map = map->next) {
+                 if (map->space->getSwapSlot(map->vpn) != -1)
+                     freeSwapSlot(map->space->getSwapSlot(map->vpn));
+                 map->space->setSwapSlot(map->vpn, slot);
+                 if (map != frame->mappings)
+                     shareSwapSlot(slot);
+             }
+         }
         
-        //printf("Page %d is dirty, write back to %s\n",phynum, filename);
+        //printf("Page %d is dirty, write back to swap slot %d\n",pagenum, slot);
         
-         OpenFile *executable = fileSystem -> Open(filename);     
-         executable ->WriteAt(&(machine ->mainMemory[phynum * PageSize]), PageSize, vpn * PageSize);
-         delete executable;
+         pinPage(pagenum);
+         writeSwap(slot, &(machine ->mainMemory[pagenum * PageSize]));
+         unpinPage(pagenum);
      }
-     //clean the page
-     cleanPage(phynum);  
-     return phynum;
+     //clean the page; every owner gets the frame back in its quota
+     for (map = frame->mappings; map != NULL; map = map->next)
+         map->space->setAvailPageNum(map->space->getAvailPageNum()+1);
+     cleanPage(pagenum);  
+}
+
+//----------------------------------------------------------------------
+// PageManager::getSwapPageClock
+//      Choose a victim with the clock (second chance) algorithm.  The
+//      hand sweeps the frame table; a frame whose "use" bit is set gets
+//      the bit cleared and is passed over, the first frame found with
+//      the bit clear is the victim.  Two sweeps always find one.
+//
+//      "space" restricts the choice to the frames of one address space;
+//      NULL means any frame may be taken.
+//----------------------------------------------------------------------
+
+int
+PageManager::getSwapPageClock(AddrSpace *space)
+{
+    DEBUG('a',"PageFault, use clock swap\n");
+    for (int i = 0; i < 2 * NumPhysPages; i++) {
+        FrameEntry *frame = &frameTable[hand];
+        int pagenum = hand;
+        hand = (hand + 1) % NumPhysPages;
+
+        if (frame->mappings == NULL || frame->pinCount > 0 ||
+                (space != NULL && !mapsPage(pagenum, space)))
+            continue;
+        if (isReferenced(pagenum)) {
+            for (FrameMapping *map = frame->mappings; map != NULL; map = map->next) {
+                map->space->CheckPrefetch(map->vpn, FALSE);
+                map->entry->use = FALSE;     // give it a second chance
+            }
+            continue;
+        }
+        return pagenum;
+    }
+    return -1;
 }
 
+//----------------------------------------------------------------------
+// PageManager::shmCreate
+//      Return the id of the shared memory segment named "key", creating
+//      it, "size" bytes long, if there is none.  The frames are taken
+//      right away (evicting pages if needed), zeroed, and pinned, so
+//      attaching never faults.  They count in the memory demand like a
+//      resident set.  "space" created it, and holds it until it exits
+//      (see shmRelease), attached or not.  -1 if the segment exists but
+//      is too small, or there is no room for it.
+//
+// PageManager::shmSize
+//      The number of pages of segment "id", -1 if there is no such
+//      segment.
+//----------------------------------------------------------------------
+
 int
-PageManager::getSwapPageFIFO()
-{
-    DEBUG('a',"PageFault, use FIFO swap\n");
-    int slot=0;
-    int min = stats->totalTicks;
-    int pagenum=machine->pageTableSize;
-    for(int i = 0; i< pagenum;i++){     				    
-       if(machine->pageTable[i].valid==TRUE &&  machine->pageTable[i].comingTime < min){
-	   min = machine->pageTable[i].comingTime;
-	   slot = i;
-	 }
-    }
-    return slot;
+PageManager::shmCreate(int key, int size, AddrSpace *space)
+{
+    int pages = divRoundUp(size, PageSize);
+    int id = -1;
+
+    if (key < 0 || size <= 0)
+        return -1;
+    for (int i = 0; i < MaxShmSegments; i++) {
+        if (shmTable[i].key == key)
+            return (pages <= shmTable[i].numPages) ? i : -1;
+        if (shmTable[i].key == -1 && id == -1)
+            id = i;
+    }
+    if (id == -1 || shmUsed + pages > MaxShmPages)
+        return -1;
+
+    ShmSegment *seg = &shmTable[id];
+    for (int i = 0; i < pages; i++) {
+        if (numClean() == 0) {
+            int victim = getSwapPageClock(NULL);
+            ASSERT(victim != -1);
+            swapPage(victim);
+        }
+        int pagenum = findPage();
+        ASSERT(pagenum != -1);
+        pinPage(pagenum);
+        frameTable[pagenum].shmSegment = id;
+        bzero(&(machine->mainMemory[pagenum * PageSize]), PageSize);
+        seg->frames[i] = pagenum;
+    }
+    seg->key = key;
+    seg->numPages = pages;
+    seg->attached = 1;                  // the creator's hold
+    seg->creator = space;
+    shmUsed += pages;
+    reserveFrames(pages);
+    DEBUG('a', "Shared memory segment %d, key %d, %d pages\n", id, key, pages);
+    return id;
 }
 
 int
-PageManager::getSwapPageLRU()
-{
-    DEBUG('a',"PageFault, use LRU swap\n");
-    int slot=0;
-    int min = stats->totalTicks;
-    int pagenum=machine->pageTableSize;
-    for(int i = 0; i< pagenum;i++){     				    
-       if(machine->pageTable[i].valid==TRUE &&  machine->pageTable[i].lastAccessTime < min){
-	   min = machine->pageTable[i].lastAccessTime;
-	   slot = i;
-	 }
-    }
-    return slot;
+PageManager::shmSize(int id)
+{
+    if (id < 0 || id >= MaxShmSegments || shmTable[id].key == -1)
+        return -1;
+    return shmTable[id].numPages;
+}
+
+//----------------------------------------------------------------------
+// PageManager::shmAttach
+//      Map the frames of segment "id" into "space", from virtual page
+//      "vpn" on.  They don't use up the resident set of "space".
+//
+// PageManager::shmDetach
+//      Undo shmAttach.  The last reference frees the segment (shmPut).
+//
+// PageManager::shmRelease
+//      "space" is going away: give up its hold on the segments it
+//      created, freeing those nobody has attached.
+//----------------------------------------------------------------------
+
+void
+PageManager::shmAttach(int id, AddrSpace *space, int vpn)
+{
+    ShmSegment *seg = &shmTable[id];
+
+    for (int i = 0; i < seg->numPages; i++) {
+        TranslationEntry *entry = space->getPageEntry(vpn + i);
+        markPage(seg->frames[i], space, vpn + i);
+        entry->valid = TRUE;
+        entry->physicalPage = seg->frames[i];
+        entry->virtualPage = vpn + i;
+        entry->use = FALSE;
+        entry->dirty = FALSE;
+        entry->readOnly = FALSE;
+        entry->comingTime = stats->totalTicks;
+    }
+    seg->attached++;
+}
+
+void
+PageManager::shmDetach(int id, AddrSpace *space, int vpn)
+{
+    ShmSegment *seg = &shmTable[id];
+
+    for (int i = 0; i < seg->numPages; i++) {
+        TranslationEntry *entry = space->getPageEntry(vpn + i);
+        entry->valid = FALSE;
+        FlushTLB(space, vpn + i);
+        unmapPage(seg->frames[i], space);
+    }
+    shmPut(id);
+}
+
+void
+PageManager::shmRelease(AddrSpace *space)
+{
+    for (int i = 0; i < MaxShmSegments; i++)
+        if (shmTable[i].key != -1 && shmTable[i].creator == space) {
+            shmTable[i].creator = NULL;
+            shmPut(i);
+        }
+}
+
+void
+PageManager::shmPut(int id)
+{
+    ShmSegment *seg = &shmTable[id];
+
+    if (--seg->attached > 0)
+        return;
+    for (int i = 0; i < seg->numPages; i++)
+        cleanPage(seg->frames[i]);
+    DEBUG('a', "Shared memory segment %d freed\n", id);
+    seg->key = -1;
+    shmUsed -= seg->numPages;
+    releaseFrames(seg->numPages);
 }
 
 void
@@ -166,7 +803,17 @@ PageManager::DumpState()
     printf("***********\n");
     printf("Pagetable state of %s\n",currentThread->getName());
     for(int i = 0; i< machine->pageTableSize;i++){
-        printf("valid:%d, vpn:%d, ppn:%d, dirty:%d, time:%d\n",machine->pageTable[i].valid,machine->pageTable[i].virtualPage,machine->pageTable[i].physicalPage,machine->pageTable[i].dirty,machine->pageTable[i].lastAccessTime);
+        TranslationEntry *entry = machine->PageTableEntry(i);
+        if(entry == NULL)
+            continue;
+        printf("valid:%d, vpn:%d, ppn:%d, dirty:%d, use:%d\n",entry->valid,entry->virtualPage,entry->physicalPage,entry->dirty,entry->use);
+    }
+    printf("Frame table, clock hand at %d\n", hand);
+    for(int i = 0; i < NumPhysPages; i++){
+        if(frameTable[i].mappings != NULL)
+            printf("ppn:%d, vpn:%d, shared:%d, pin:%d, use:%d, dirty:%d\n", i,
+                   frameTable[i].mappings->vpn, frameTable[i].numMappings,
+                   frameTable[i].pinCount, isReferenced(i), isDirty(i));
     }
     printf("***********\n");
 }
@@ -1,7 +1,74 @@
 #ifndef MANAGE
 #define MANAGE
+#include "machine.h"
 #include "bitmap.h"
 
+class AddrSpace;
+
+// One virtual page mapped into a physical page.  After a fork the
+// father and the child map the same physical pages read-only, so a
+// physical page may have several mappings.
+
+class FrameMapping
+{
+     public:
+            AddrSpace *space;       // Address space mapping the frame
+            int vpn;                // Virtual page of "space" held in the frame
+            TranslationEntry *entry;   // Its translation
+            FrameMapping *next;
+};
+
+// The following class describes one physical page: who maps it, and
+// whether it may be replaced.  The reference and dirty state of the
+// frame are the "use" and "dirty" bits of the translation entries
+// mapping it, which the hardware sets on every access.
+
+class FrameEntry
+{
+     public:
+            FrameMapping *mappings; // Mappings of the frame, NULL if the frame is free
+            int numMappings;
+            bool dirty;             // Modified before it became shared copy-on-write
+            int pinCount;           // The frame can't be replaced while > 0
+            int execSector;         // For a code page in the text cache, the header
+            int textVpn;            // sector of its executable and its virtual page,
+            int textNext;           // and the next frame in the hash chain; else -1
+            int shmSegment;         // Shared memory segment holding the frame, or -1
+};
+
+#define TextHashSize	NumPhysPages
+
+// Shared memory segments (see ShmCreate in syscall.h).  The frames of a
+// segment are allocated when it is created, stay pinned, and are mapped
+// into every address space attaching it.  The creator holds the segment
+// until it exits, so it can be attached later by others; the segment is
+// freed once its creator is gone and the last attacher detached.
+
+#define MaxShmSegments	8
+#define MaxShmPages	(NumPhysPages/4)	// frames all segments may hold
+
+class ShmSegment
+{
+     public:
+            int key;                // Name given by the users, -1 if the slot is free
+            int numPages;
+            int frames[MaxShmPages];
+            int attached;           // Number of address spaces attaching it,
+                                    // plus one while its creator is alive
+            AddrSpace *creator;
+};
+
+// Page-fault-frequency allocation.  Every process has a resident set
+// limit; one that faults again within PFFLowInterval ticks gets one
+// more frame, one that goes PFFHighInterval ticks without a fault
+// gives one back.  When the limits add up to more than the memory,
+// a process is suspended to make room.
+
+#define InitialResident	(NumPhysPages/4)	// limit a process starts with
+#define MinResident	2
+#define PFFLowInterval	500
+#define PFFHighInterval	5000
+
 class PageManager
 {
 
@@ -9,28 +76,80 @@ class PageManager
             PageManager();
             ~PageManager();
  
-            int findPage();         // Find a clean page in the memory 
-                                         // and allocate to the program, return the start address of the clear page
-                                         // 0xffffffff means that there is not a clean page
+            int findPage();         // Take a clean physical page off the free list,
+                                         // return its number, or -1 if there is no clean page
 
             int numClean();              // Return the number of clean pages
     
-            void markPage(int address);   // Set the page start from the specific address
+            void markPage(int pagenum, AddrSpace *space, int vpn);   // Map virtual page "vpn" of
+                                                                    // "space" to a physical page
+            void unmapPage(int pagenum, AddrSpace *space);   // Remove the mapping of "space",
+                                                             // free the page if it was the last one
             
-            void cleanPage(int address); // Clean the page start from specific address 
+            void cleanPage(int pagenum); // Put a physical page back on the free list
+
+            void pinPage(int pagenum);      // Keep a physical page from being replaced,
+            void unpinPage(int pagenum);    // e.g. while it is being read or written
+            bool isPinned(int pagenum){return frameTable[pagenum].pinCount > 0;}
+
+            void reserveFrames(int count);  // Resident set limits entering/leaving the
+            void releaseFrames(int count);  // memory demand (new, exiting, suspended processes)
+            void adjustResidentSet(AddrSpace *space);   // page-fault-frequency policy
+
+            bool isReferenced(int pagenum);  // Reference/dirty state of a physical page
+            bool isDirty(int pagenum);
+
+            void shareAll(AddrSpace *father, AddrSpace *child);  // Fork: map the resident pages of
+                                                                 // "father" copy-on-write into "child"
 
             void loadPage(int address);             // load page for the current thread
+            void prefetchPages(AddrSpace *space, int vpn, int stride, int count);
+                                                    // fault-around: load up to "count" more pages
+
+            int findTextPage(int execSector, int vpn);    // Text cache: the physical page holding
+                                                          // code page "vpn" of an executable, or -1
+
+            void copyOnWrite(int address);          // first write of the current thread to a
+                                                    // page shared copy-on-write
    
-            int swapPage(int entryid, char *filename);            // unload page for the current thread 
+            void swapPage(int pagenum);            // write a physical page to the swap area if needed and free it
 
-            int getSwapPageFIFO();         // swap a page from the memory to the disk
-            
-            int getSwapPageLRU();         // swap a page from the memory to the disk
+            int allocSwapSlot();            // Find a free slot in the swap area, one page per slot
+            void shareSwapSlot(int slot);   // One more virtual page uses the slot
+            void freeSwapSlot(int slot);    // One less; the slot is free once nobody uses it
+            void readSwap(int slot, char *into);    // Transfer one page from/to the swap area
+            void writeSwap(int slot, char *from);
+
+            int getSwapPageClock(AddrSpace *space);   // choose a physical page to swap out with the
+                                                      // clock algorithm, among the pages of "space"
+                                                      // or, if "space" is NULL, among all pages
+
+            int shmCreate(int key, int size, AddrSpace *space);
+                                                // Find or create (for "space") the
+                                                // segment "key", return its id or -1
+            int shmSize(int id);                // Pages of segment "id", -1 if none
+            void shmAttach(int id, AddrSpace *space, int vpn);  // Map/unmap segment "id" at
+            void shmDetach(int id, AddrSpace *space, int vpn);  // virtual page "vpn" of "space"
+            void shmRelease(AddrSpace *space);  // "space" exits: drop the segments it created
 
             void DumpState();   
 
      private:
-            BitMap *manager;
+            bool mapsPage(int pagenum, AddrSpace *space);
+            void addTextPage(int pagenum, int execSector, int vpn);
+            void removeTextPage(int pagenum);
+            void shmPut(int id);        // One reference to segment "id" less
+
+            FrameEntry *frameTable;     // One entry per physical page
+            int *freeFrames;            // Stack of free physical pages
+            int numFree;                // Number of entries on "freeFrames"
+            int hand;                   // Clock hand, the next frame to inspect
+            BitMap *swapMap;            // Free slots of the swap area
+            int *swapRefs;              // Number of virtual pages using each slot
+            int textHash[TextHashSize]; // Heads of the text cache hash chains
+            int committed;              // Sum of the resident set limits of active processes
+            ShmSegment shmTable[MaxShmSegments];
+            int shmUsed;                // Frames held by shared memory segments
     
 };
-#endif
\ No newline at end of file
+#endif
@@ -42,19 +42,7 @@ StartProcess(char *filename)
     }
     space = new AddrSpace(executable);    
 
-    char *tempfile=new char[50];
-    char *tid=new char[10];
-    sprintf(tid,"%d",currentThread->getTID());
-    int filesize = (space ->getPageNum()) * PageSize ;
-    strcpy(tempfile,filename);
-    strcat(tempfile,tid);
-    //printf("name:%s\n",tempfile);
-    space->CreateTempFile(executable, tempfile, filesize);
-
-    currentThread->space = space;
-    currentThread->space->setFileName(tempfile);
-  
-    delete executable;			// close file
+    currentThread->space = space;		// "space" keeps the file open
     
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
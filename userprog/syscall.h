@@ -31,6 +31,15 @@
 #define SC_Yield	10
 
 #define SC_Print 11
+#define SC_Enter	12
+#define SC_Mmap		13
+#define SC_Munmap	14
+#define SC_ShmCreate	15
+#define SC_ShmAttach	16
+#define SC_ShmDetach	17
+
+/* Number of slots in a batched system call ring (see Enter below) */
+#define RingSize	16
 
 #ifndef IN_ASM
 
@@ -128,6 +137,69 @@ void Yield();
 
 void Print(char* arg,int choice);
 
+/* Batched file system calls.  Instead of trapping once per operation,
+ * a user program queues requests in a ring that lives in its own
+ * address space, and hands the whole ring to the kernel with a single
+ * Enter trap.
+ *
+ * To submit, fill in entries[tail % RingSize] and increment tail.  Enter
+ * consumes every entry from head up to tail in order, stores each
+ * operation's return value in its "result" field (-1 on failure), advances
+ * head to tail and returns the number of entries processed.
+ *
+ * Supported operations, with the same arguments as the direct calls:
+ *	SC_Create  arg1 = name
+ *	SC_Open    arg1 = name			result = OpenFileId
+ *	SC_Read    arg1 = buffer, arg2 = size, arg3 = id	result = bytes read
+ *	SC_Write   arg1 = buffer, arg2 = size, arg3 = id	result = bytes written
+ *	SC_Close   arg1 = id
+ */
+typedef struct {
+    int op;			/* system call code of the operation */
+    int arg1, arg2, arg3;	/* arguments, as for the direct call */
+    int result;			/* return value, filled in by the kernel */
+} RingEntry;
+
+typedef struct {
+    int head;			/* next entry the kernel will consume */
+    int tail;			/* next free entry for the user */
+    RingEntry entries[RingSize];
+} SyscallRing;
+
+int Enter(SyscallRing *ring);
+
+/* Memory-mapped files.  Mmap maps "length" bytes of the open file "id",
+ * starting at "offset" (a multiple of the page size), into the address
+ * space, and returns the address of the mapping, or 0 if it can't be
+ * done.  The range must lie within the file.  Loads and stores to the
+ * mapping read and write the file directly; changes reach the disk when
+ * a page is evicted, at Munmap, or at Exit.  Mappings are not inherited
+ * by Fork.
+ *
+ * Munmap removes the mapping that starts at "addr", returning 0, or -1
+ * if there is none.
+ */
+void *Mmap(OpenFileId id, int offset, int length);
+
+int Munmap(void *addr);
+
+/* Shared memory.  ShmCreate returns the id of the segment named "key"
+ * (any number >= 0 the cooperating programs agree on), creating it,
+ * "size" bytes long and zero-filled, if it doesn't exist yet; -1 if the
+ * existing segment is smaller or there is no memory left for it.
+ * ShmAttach maps the segment into the address space and returns its
+ * address (0 on error): every program attaching it sees the same
+ * physical memory, so data is exchanged without any copy.  ShmDetach
+ * unmaps the segment attached at "addr"; the segment is freed when the
+ * program that created it has exited and the last program attaching it
+ * detached it (or exited).  Fork does not inherit attachments.
+ */
+int ShmCreate(int key, int size);
+
+void *ShmAttach(int id);
+
+int ShmDetach(void *addr);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */